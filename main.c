@@ -10,18 +10,37 @@
 #include <time.h>
 #include <sys/time.h> // Add this include for precise timing
 #include <pthread.h> // Add this include for pthreads
+#include <math.h> // For the low-rank factorization
+#include <stdint.h>
+#include <stdatomic.h> // For the lock-free prediction cache
+#include <sys/mman.h> // For huge-page backed allocations
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h> // For dTLB miss counting
+#include <fcntl.h>
+#include <sys/stat.h> // For mapping the binary datasets
 
 // SDL2 windows size definition
 #define WINDOW_WIDTH 560  // 28*20
 #define WINDOW_HEIGHT 560 // 28*20
 #define PIXEL_SIZE 20     // Each MNIST pixel size 20x20
+#define GRID_SIDE 20      // Grid mode: 20x20 thumbnails at 28x28 each
+#define GRID_CELLS (GRID_SIDE * GRID_SIDE)
+#define GLYPH_SCALE 8     // Overlay digits: 3x5 font, 8 screen pixels per dot
 
 // Visualizer struct definition
 typedef struct {
     SDL_Window *window;
     SDL_Renderer *renderer;
-    int current_image;
+    SDL_Texture *image;       // 28x28 streaming texture, scaled by the renderer
+    SDL_Texture *grid;        // 560x560 streaming texture of thumbnails
+    int current_image;        // position in `visible`
     int running;
+    int grid_mode;
+    int only_errors;          // show misclassified rows only
+    int *visible;             // rows that can be browsed
+    int num_visible;
+    const int *labels;        // may be NULL; predictions come from prediction_feed
 } Viewer;
 
 // Time measurement struct
@@ -32,6 +51,53 @@ typedef struct {
     const char* operation;
 } TimingInfo;
 
+// One set of network parameters: parameters/weights<layer>_<seed>.csv and biases<layer>_<seed>.csv
+typedef struct {
+    int seed;
+    double **weights[4];
+    double *biases[4];
+} Model;
+
+// A published parameter set. The Model is never modified once published;
+// readers pin it with a reference taken inside an epoch read section (see
+// model_acquire()), and it is freed when the last reference is dropped.
+typedef struct {
+    Model *model;
+    int generation;          // 0 = the parameters loaded at startup
+    int owned;               // loaded by a reload: freed together with this
+    atomic_int refs;         // the publication itself holds one
+    atomic_long rows_served;
+} LiveModel;
+
+// Readers announce themselves in one of these slots while they load the
+// model pointer and take their reference; a swap waits for every slot to
+// drain once (the grace period) before dropping the old model.
+#define MODEL_READER_SLOTS 64
+typedef struct {
+    atomic_int active;
+} __attribute__((aligned(64))) ReaderSlot;
+
+// Evaluation metrics, accumulated per thread while inference runs and merged after
+#define NUM_CLASSES 10
+#define TOPK_MAX 3                 // rankings keep the 3 best classes, 4 bits each
+#define MAX_LOGGED_ERRORS 1000
+
+typedef struct {
+    int row;
+    int predicted;
+    int actual;
+} ErrorEntry;
+
+typedef struct {
+    long confusion[NUM_CLASSES][NUM_CLASSES];  // [actual][predicted]
+    long topk_hits[TOPK_MAX];                  // label among the k+1 best outputs
+    long samples;
+    long errors;
+    ErrorEntry *logged;                        // first misclassified rows, in row order
+    int nlogged;
+    int row_base;                              // added to row numbers when printing
+} EvalTally;
+
 // Add this new structure for per-thread work:
 typedef struct {
     int thread_id;
@@ -39,24 +105,330 @@ typedef struct {
     int end;           // end row (exclusive)
     double **input_data;
     int *predictions;
+    long cache_hits;   // per-thread prediction cache counters
+    long cache_misses;
+    long cache_uncacheable;  // rows with pixels the cache cannot key
+    int *rankings;     // optional: top-k ranking per row (see rank_outputs)
+    const int *labels; // optional: ground truth for the tally
+    EvalTally tally;   // thread-local metrics
+    atomic_int *published; // optional: rows of this block already in predictions
+    const Model *model;    // parameters to use; NULL = base_model
 } ThreadData;
 
+// Lock-free publication of a running forward pass. Each worker release-stores
+// how many rows of its block are final; readers acquire-load that count before
+// touching predictions[], so a row is read only after it was written.
+typedef struct {
+    int *_Atomic predictions;  // NULL until a pass starts
+    int nrows;
+    int nthreads;
+    int rows_per_thread;
+    atomic_int *published;     // one counter per worker
+} PredictionFeed;
+
+// Single-sample inference: each layer's outputs are packed in panels of
+// GEMV_LANES neurons, input-major inside a panel, so one sweep over the
+// input feeds GEMV_LANES independent sums that vectorize. All layers live
+// in one 64-byte aligned block.
+#define GEMV_LANES 8           // one 64-byte cache line of doubles
+#define LATENCY_MAX_WIDTH 256  // widest layer output (200) rounded up
+typedef struct {
+    double *weights[4];  // layer l: panels of matrices_rows[l] x GEMV_LANES
+    double *biases[4];   // padded to whole panels
+    int panels[4];
+    double *block;
+} PackedModel;
+
+// Helper threads that spin waiting for an image and each compute one slice
+// of the 200 layer-0 outputs.
+typedef struct LatencyPool LatencyPool;
+typedef struct {
+    LatencyPool *pool;
+    int first;  // layer-0 output panels [first, last)
+    int last;
+    pthread_t thread;
+} LatencyHelper;
+
+struct LatencyPool {
+    LatencyHelper *helpers;
+    int nhelpers;
+    int own_last;                // the caller computes panels [0, own_last)
+    atomic_int generation;       // bumped by the caller once per image
+    atomic_int done;             // helpers finished with the current image
+    atomic_int stop;
+    const double *input;         // published before generation
+    double *hidden;              // layer-0 outputs, aligned to cache lines
+};
+
+// Multi-process evaluation: the coordinator forks one worker per row range
+// and every worker reports into its slot of a MAP_SHARED region.
+#define SHARD_MAX 64
+#define SHARD_MAX_ATTEMPTS 3
+#define SHARD_TIMEOUT_SEC 600  // per attempt; NN_SHARD_TIMEOUT overrides it
+typedef enum {
+    SHARD_PENDING,
+    SHARD_RUNNING,
+    SHARD_DONE
+} ShardStatus;
+
+typedef struct {
+    atomic_int status;             // SHARD_DONE is stored last by the worker
+    pid_t pid;                     // coordinator bookkeeping
+    double started;                // coordinator bookkeeping: fork time of this attempt
+    int timed_out;                 // coordinator bookkeeping: killed at the deadline
+    int first;                     // rows [first, first + count)
+    int count;
+    int attempts;
+    double seconds;
+    long confusion[NUM_CLASSES][NUM_CLASSES];  // the worker's EvalTally, flattened
+    long topk_hits[TOPK_MAX];
+    long samples;
+    long errors;
+    int nlogged;
+    ErrorEntry logged[MAX_LOGGED_ERRORS];      // absolute row numbers
+} ShardSlot;
+
+// Settings picked by autotune(), stored per CPU model in autotune.profile
+typedef struct {
+    int threads;
+    int micro_batch;
+    int tile_rows;
+    int tile_k;
+    double seconds;  // best time on the autotune sample
+} AutotuneProfile;
+
+// Forward pass run by the coordinator thread while the viewer owns the main thread
+typedef struct {
+    double **data;
+    int *predictions;
+    TimingInfo *timing;
+    long long dtlb_misses;
+    long huge_kb;
+    atomic_int finished;
+} InferenceJob;
+
+// Backing of a large allocation (see big_alloc)
+typedef enum {
+    BACKING_MALLOC,    // plain malloc, 4 KB pages
+    BACKING_MMAP,      // mmap with 4 KB pages (THP refused)
+    BACKING_THP,       // mmap + madvise(MADV_HUGEPAGE)
+    BACKING_HUGETLB,   // mmap(MAP_HUGETLB), reserved 2 MB pages
+    BACKING_FILE       // read-only mapping of a binary dataset file
+} MemBacking;
+
+// Header in front of every big_alloc block so big_free knows how to release it
+typedef struct {
+    size_t bytes;       // requested size
+    size_t map_bytes;   // length of the mapping (0 for malloc)
+    void *map_start;
+    MemBacking backing;
+} __attribute__((aligned(64))) BigAllocHeader;
+
+// Size and mtime of a source CSV when a converted copy was written. A copy
+// (data.bin, data.idx, digits.idx) is only used while data.csv and
+// digits.csv both still match, so images and labels never mix generations.
+#define DATASET_SOURCES 2  // data.csv, digits.csv
+typedef struct {
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} SourceStamp;
+
+// Sidecar <file>.src of a converted IDX file (IDX has no room for it)
+#define SOURCE_STAMP_MAGIC "NNSRC001"
+typedef struct {
+    char magic[8];
+    SourceStamp csv[DATASET_SOURCES];
+} SourceStampFile;
+
+// Header of our own binary dataset dump (csvs/data.bin), followed by
+// nrows * ncols native doubles that are used in place, without parsing.
+#define DATA_BIN_MAGIC "NNDATA02"
+typedef struct {
+    char magic[8];
+    uint32_t nrows;
+    uint32_t ncols;
+    uint32_t elem_size;     // sizeof(double)
+    uint32_t reserved0;
+    SourceStamp csv[DATASET_SOURCES];  // data.csv and digits.csv it was converted from
+    uint32_t reserved[14];  // pads the header to 128 bytes
+} DataBinHeader;
+_Static_assert(sizeof(DataBinHeader) == 128, "data.bin header must stay 128 bytes");
+
+// Byte offsets of every row of data.csv, kept in a sidecar file
+// (data.csv.rows) and reused while the CSV's size and mtime are unchanged.
+#define ROW_INDEX_MAGIC "NNROWS01"
+typedef struct {
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t nrows;      // followed by nrows + 1 offsets (the last one is the file size)
+} RowIndexHeader;
+
+typedef struct {
+    uint64_t *offsets;   // nrows + 1 entries
+    int nrows;
+    char *map;           // read-only mapping of data.csv
+    size_t map_bytes;
+} RowIndex;
+
+// Per-thread work for the ensemble evaluation
+typedef struct {
+    int start;
+    int end;
+    double **input_data;
+    Model *models;
+    int nmodels;
+    int *predictions;     // ensemble (averaged-logit) predictions
+    int *model_correct;   // per-model correct counts for this thread
+    int ensemble_correct;
+} EnsembleThreadData;
+
+// Shared state and per-thread gradients of the training engine
+typedef struct TrainState TrainState;
+
+typedef struct {
+    int thread_id;
+    TrainState *state;
+    double **grad_w[4];   // thread-local gradients, reduced without locks
+    double *grad_b[4];
+    double **batch;       // this thread's share of the mini-batch (scaled to [0, 1])
+    double loss;          // summed cross-entropy of this epoch
+    int correct;          // training rows predicted correctly this epoch
+    int eval_correct;     // held-out rows predicted correctly after this epoch
+} TrainThreadData;
+
+struct TrainState {
+    Model model;          // parameters in [0, 1] input units while training
+    double **data;        // raw 0-255 rows
+    TrainThreadData *threads;
+    int nthreads;
+    int epochs;
+    int train_rows;       // order[0, train_rows) is trained on, the rest is held out
+    int *order;           // row order: training rows reshuffled every epoch, then the held-out slice
+    unsigned shuffle_seed;
+    long param_count;
+    pthread_barrier_t barrier;
+};
+
+// Prediction cache: rows are keyed by a 64-bit hash of their 784 pixels and
+// verified against a copy of the pixels kept in the cache, so a hit is always
+// an exact match and never depends on the caller's buffer staying alive.
+// Readers never lock (seqlock per entry); writers lock only their shard.
+#define CACHE_SHARDS 64
+#define CACHE_WAYS 4
+#define CACHE_KEY_WORDS 98  // 784 pixels, one byte each, 8 per word
+#define CACHE_MAX_ENTRIES 65536  // ~51 MB of pixel copies
+
+typedef struct {
+    atomic_uint_fast64_t version;   // odd while the entry is being written
+    _Atomic uint64_t hash;
+    atomic_int filled;              // 0 while the entry is empty
+    atomic_int ranking;             // packed top-k ranking, prediction = ranking & 0xF
+    atomic_int generation;          // model generation that computed it
+} CacheEntry;
+
+typedef struct {
+    pthread_mutex_t lock;          // serializes writers of this shard
+    CacheEntry *entries;           // buckets * CACHE_WAYS entries
+    _Atomic uint64_t *keys;        // CACHE_KEY_WORDS pixel words per entry
+    int buckets;
+    unsigned clock;                // round-robin victim for full buckets
+    long evictions;
+} __attribute__((aligned(64))) CacheShard;
+
 // Function prototypes
 int control_errores(const char *checkFile);
 int read_matrix(double **mat, char *file, int nrows, int ncols, int fac);
 int read_vector(double *vect, char *file, int nrows);
 void print_matrix(double **mat, int nrows, int ncols, int offset_row, int offset_col);
 void load_data(char *path);
+void load_data_lazy(char *path);
+static void load_digits(char *path);
+static void load_images(char *path);
+static void load_parameters(char *path);
 void unload_data(void);
+int row_index_open(RowIndex *index, char *csv_file);
+int row_index_read_rows(RowIndex *index, int first, int count, double **out);
+void row_index_close(RowIndex *index);
+double *viewer_row(double **data, int index);
+int* parallel_forward_rows(double **rows, const int *row_labels, int nrows);
+int load_model(Model *model, char *path, int seed);
+void unload_model(Model *model);
+double** model_forward(Model *model, double **input, int rows);
+void ensemble_evaluate(double **data, char *path, int *seeds, int nmodels);
+int write_matrix(double **mat, char *file, int nrows, int ncols);
+int write_vector(double *vect, char *file, int nrows);
+void train_model(double **data, char *path, int epochs, int out_seed);
 double** mat_mul(double **input, int input_rows, int input_cols, double **weights, int weight_cols);
 double** sum_vect(double **matrix, double *vector, int nrows, int ncols);
 double** relu(double **matrix, int nrows, int ncols);
 int* argmax(double **matrix, int rows, int cols);
-void free_matrix(double **matrix, int rows);
+void free_matrix(double **matrix);
 int* forward_pass(double **data);
+double** alloc_matrix(int nrows, int ncols);
+void *big_alloc(size_t bytes, MemBacking *backing);
+void big_free(void *ptr);
+const char *backing_name(MemBacking backing);
+int dtlb_counter_open(void);
+long long dtlb_counter_read(int fd);
+void hugepage_benchmark(double **data);
+void *map_file(const char *file, size_t *bytes);
+int read_idx_images(double **mat, char *file, int nrows, int ncols);
+int read_idx_labels(double *vect, char *file, int nrows);
+int write_idx_images(double **mat, char *file, int nrows, int ncols);
+int write_idx_labels(double *vect, char *file, int nrows);
+int write_data_bin(double **mat, char *file, int nrows, int ncols, const SourceStamp *stamps);
+void convert_dataset(char *path);
+double** layer0_mat_mul(double **input, int rows, const Model *model);
+int lowrank_factorize(double **weights, int nrows, int ncols, int rank, double ***a_out, double ***b_out);
+void lowrank_unload(void);
+void lowrank_sweep(double **data);
+uint64_t hash_row(const double *row, int ncols);
+void prediction_cache_init(int capacity);
+void prediction_cache_clear(void);
+void prediction_cache_free(void);
+int prediction_cache_lookup(uint64_t hash, const double *row, int generation, int *ranking);
+void prediction_cache_insert(uint64_t hash, const double *row, int generation, int ranking);
+LiveModel *model_acquire(void);
+void model_release(LiveModel *live);
+int model_swap(Model *model);
+int model_reload(char *path, int seed);
+void reload_watcher_start(char *path);
+void reload_watcher_stop(void);
+void hotswap_demo(double **data, char *path, int new_seed);
+void shard_evaluate(double **data, int nshards);
+int rank_outputs(const double *outputs, int n);
+void tally_init(EvalTally *tally);
+void tally_add(EvalTally *tally, int row, int ranking, int label);
+void tally_merge(EvalTally *dst, const EvalTally *src);
+void tally_free(EvalTally *tally);
+double final_result(const EvalTally *tally);
+void print_eval_report(const EvalTally *tally);
+int cached_thread_forward(ThreadData *td);
+void print_counter(const char* label, long value);
+void print_info(const char* label, const char* value);
 char *siguiente_token(char *buffer);
-void view_mnist_images(double **data, int num_images);
-double error_log(int *predictions, double *actual_digits, int num_samples, int max_errors_to_log);
+void view_mnist_images(double **data, int num_images, const int *row_labels);
+double error_log(const EvalTally *tally, int max_errors_to_log);
+void prediction_feed_open(int *predictions, int nrows);
+int prediction_feed_rows(void);
+int prediction_feed_get(int row);
+long prediction_feed_done(void);
+void prediction_feed_free(void);
+void inference_job_open(InferenceJob *job);
+void *inference_coordinator(void *arg);
+int cpu_model_name(char *name, size_t size);
+int packed_model_init(const Model *model);
+void packed_model_free(void);
+int latency_pool_start(int nhelpers);
+void latency_pool_stop(void);
+int predict_one(const double *input);
+void latency_benchmark(double **data, int samples);
+int autotune_load(const char *path, AutotuneProfile *profile);
+void autotune_save(const char *path, const AutotuneProfile *profile);
+void autotune(double **data, const char *path, int max_threads);
 
 // Move these function declarations up with other function prototypes (after TimingInfo struct definition)
 void start_timing(TimingInfo* timing, const char* operation);
@@ -82,6 +454,23 @@ int vector_rows[4] = {200, 100, 50, 10};
 char *str;  // for building file paths
 
 static double *digits;
+static int *labels;       // digits as ints, converted once at load time
+EvalTally eval_result;    // metrics of the last parallel forward pass
+static Model base_model;  // parameters for `seed`; mat1..vec4 point into it
+
+// Hot-swappable parameters. Workers read live_model only through
+// model_acquire(); base_live wraps base_model and is never freed.
+static LiveModel base_live;
+static LiveModel *_Atomic live_model;
+static ReaderSlot model_readers[MODEL_READER_SLOTS];
+static atomic_int model_generations;      // last generation handed out
+static atomic_int next_reader_slot;
+static _Thread_local int reader_slot = -1;
+static pthread_mutex_t model_swap_lock = PTHREAD_MUTEX_INITIALIZER;  // one writer at a time
+int reload_seed = -1;                     // seed re-read on SIGHUP (-1: seed)
+static pthread_t reload_thread;
+static int reload_running;
+static atomic_int reload_stop;
 static double **mat1;
 static double **mat2;
 static double **mat3;
@@ -91,9 +480,200 @@ static double *vec2;
 static double *vec3;
 static double *vec4;
 
-// Function to visualize MNIST images
-void view_mnist_images(double **data, int num_images) {
-    if (data == NULL || num_images <= 0) {
+// Low-rank layer 0: mat1 (784 x 200) ~= mat1_a (784 x r) * mat1_b (r x 200).
+// lowrank_rank == 0 means the full mat1 is used.
+int lowrank_rank = 0;
+static double **mat1_a;
+static double **mat1_b;
+
+// Memory backend: allocations of at least HUGE_ALLOC_MIN bytes try 2 MB pages.
+// With hugepages_enabled = 0 they are mapped with THP refused instead.
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define HUGE_ALLOC_MIN (1UL * 1024 * 1024)
+int hugepages_enabled = 1;
+static MemBacking data_backing = BACKING_MALLOC;
+static atomic_long backing_bytes[5];  // bytes currently held per MemBacking
+static RowIndex data_index;           // row offsets of data.csv in the lazy modes
+#define VIEWER_PAGE_ROWS 16
+static double **viewer_page;          // rows the lazy viewer parsed last
+static int viewer_page_first = -1;
+static void *data_map;                // mapping of csvs/data.bin when used in place
+static size_t data_map_bytes;
+
+// Prediction cache state and the counters of the last parallel forward pass.
+// The cache is off unless NN_CACHE=1; main() sizes it from data_nrows.
+int cache_enabled = 0;
+int cache_capacity;
+static CacheShard cache_shards[CACHE_SHARDS];
+long cache_hits_total;
+long cache_misses_total;
+long cache_uncacheable_total;
+
+// Tunables; autotune() picks them per host and main() loads the saved profile.
+#define MICRO_BATCH_MAX 1024
+int micro_batch_rows = 256;  // rows per cache lookup / publication chunk
+int matmul_tile_rows = 16;   // mat_mul blocking: input rows per tile
+int matmul_tile_k = 64;      // mat_mul blocking: inner dimension per tile
+int forward_verbose = 1;     // per-thread progress output of parallel_forward_rows()
+#define AUTOTUNE_PROFILE "autotune.profile"
+#define AUTOTUNE_SAMPLE_ROWS 6000
+#define AUTOTUNE_REPEATS 3
+
+static PackedModel packed_model;       // transposed weights for predict_one()
+static LatencyPool latency_pool;       // intra-sample helpers (nhelpers == 0: none)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+static PredictionFeed prediction_feed;  // predictions of the running forward pass
+#define VIEWER_REFRESH_MS 100            // viewer poll period while inference runs
+
+// 3x5 bitmap font for the overlay: digits 0-9 and '?', one bit per dot,
+// rows top to bottom, most significant bit on the left.
+static const unsigned short viewer_font[11] = {
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF, 0x7282
+};
+
+// Draw one glyph with its dark backdrop; only lit dots cost a FillRect.
+static void viewer_draw_glyph(SDL_Renderer *renderer, int x, int y, int glyph, Uint8 r, Uint8 g, Uint8 b) {
+    SDL_Rect backdrop = {x - GLYPH_SCALE / 2, y - GLYPH_SCALE / 2, 4 * GLYPH_SCALE, 6 * GLYPH_SCALE};
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(renderer, &backdrop);
+    SDL_SetRenderDrawColor(renderer, r, g, b, 255);
+    for (int dot = 0; dot < 15; dot++) {
+        if (viewer_font[glyph] & (0x4000 >> dot)) {
+            SDL_Rect rect = {x + (dot % 3) * GLYPH_SCALE, y + (dot / 3) * GLYPH_SCALE, GLYPH_SCALE, GLYPH_SCALE};
+            SDL_RenderFillRect(renderer, &rect);
+        }
+    }
+}
+
+static inline Uint32 viewer_gray(double value) {
+    Uint32 v = value <= 0 ? 0 : value >= 255 ? 255 : (Uint32)value;
+    return 0xFF000000u | (v << 16) | (v << 8) | v;
+}
+
+// Copy a 28x28 row into a locked texture at (x, y).
+static void viewer_blit(Uint32 *pixels, int pitch, int x, int y, const double *row) {
+    for (int i = 0; i < 28; i++) {
+        Uint32 *line = (Uint32 *)((char *)pixels + (y + i) * pitch) + x;
+        for (int j = 0; j < 28; j++) {
+            line[j] = viewer_gray(row[i * 28 + j]);
+        }
+    }
+}
+
+// Label of a row, or 10 ('?') when unknown. The lazy viewer may index more
+// rows than labels were loaded for.
+static int viewer_label(const Viewer *viewer, int row) {
+    if (!viewer->labels || row >= data_nrows) return 10;
+    int label = viewer->labels[row];
+    return (label < 0 || label > 9) ? 10 : label;
+}
+
+// Predicted digit, or 10 ('?') while the row is still being inferred.
+static int viewer_prediction(int row) {
+    int predicted = prediction_feed_get(row);
+    return (predicted < 0) ? 10 : predicted;
+}
+
+static int viewer_is_error(const Viewer *viewer, int row) {
+    int predicted = viewer_prediction(row);
+    return predicted != 10 && viewer->labels && predicted != viewer_label(viewer, row);
+}
+
+// Rebuild the list of browsable rows for the current filter, staying at
+// (or just after) the row that was on screen.
+static void viewer_filter(Viewer *viewer, int num_images) {
+    int shown = (viewer->num_visible > 0) ? viewer->visible[viewer->current_image] : 0;
+    viewer->num_visible = 0;
+    viewer->current_image = 0;
+    for (int i = 0; i < num_images; i++) {
+        if (!viewer->only_errors || viewer_is_error(viewer, i)) {
+            if (i <= shown) viewer->current_image = viewer->num_visible;
+            viewer->visible[viewer->num_visible++] = i;
+        }
+    }
+}
+
+// Stream the current image (or page of thumbnails) into its texture and present it.
+static void viewer_render(Viewer *viewer, double **data) {
+    void *pixels;
+    int pitch;
+    char title[128];
+
+    SDL_SetRenderDrawColor(viewer->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(viewer->renderer);
+
+    if (viewer->num_visible == 0) {
+        SDL_SetWindowTitle(viewer->window, "MNIST Viewer - no misclassified images ('m' to show all)");
+        SDL_RenderPresent(viewer->renderer);
+        return;
+    }
+
+    if (viewer->grid_mode) {
+        int page = viewer->current_image / GRID_CELLS;
+        int first = page * GRID_CELLS;
+        int cells = (viewer->num_visible - first < GRID_CELLS) ? viewer->num_visible - first : GRID_CELLS;
+        if (SDL_LockTexture(viewer->grid, NULL, &pixels, &pitch) == 0) {
+            memset(pixels, 0, (size_t)pitch * WINDOW_HEIGHT);
+            for (int c = 0; c < cells; c++) {
+                viewer_blit(pixels, pitch, (c % GRID_SIDE) * 28, (c / GRID_SIDE) * 28,
+                            viewer_row(data, viewer->visible[first + c]));
+            }
+            SDL_UnlockTexture(viewer->grid);
+        }
+        SDL_RenderCopy(viewer->renderer, viewer->grid, NULL, NULL);
+        // Outline misclassified thumbnails unless every one of them is
+        SDL_SetRenderDrawColor(viewer->renderer, 255, 0, 0, 255);
+        for (int c = 0; !viewer->only_errors && c < cells; c++) {
+            if (viewer_is_error(viewer, viewer->visible[first + c])) {
+                SDL_Rect rect = {(c % GRID_SIDE) * 28, (c / GRID_SIDE) * 28, 28, 28};
+                SDL_RenderDrawRect(viewer->renderer, &rect);
+            }
+        }
+        snprintf(title, sizeof(title), "MNIST Viewer - page %d/%d (%d %s images) - g: single, m: filter",
+                 page + 1, (viewer->num_visible + GRID_CELLS - 1) / GRID_CELLS, viewer->num_visible,
+                 viewer->only_errors ? "misclassified" : "total");
+    } else {
+        int row = viewer->visible[viewer->current_image];
+        if (SDL_LockTexture(viewer->image, NULL, &pixels, &pitch) == 0) {
+            viewer_blit(pixels, pitch, 0, 0, viewer_row(data, row));
+            SDL_UnlockTexture(viewer->image);
+        }
+        SDL_RenderCopy(viewer->renderer, viewer->image, NULL, NULL);
+
+        // Predicted digit top-left (green if right, red if wrong), actual top-right
+        int predicted = viewer_prediction(row);
+        int actual = viewer_label(viewer, row);
+        int wrong = viewer_is_error(viewer, row);
+        viewer_draw_glyph(viewer->renderer, GLYPH_SCALE, GLYPH_SCALE, predicted,
+                          wrong ? 255 : 0, wrong ? 64 : 220, wrong ? 64 : 0);
+        viewer_draw_glyph(viewer->renderer, WINDOW_WIDTH - 4 * GLYPH_SCALE, GLYPH_SCALE, actual, 255, 255, 255);
+
+        snprintf(title, sizeof(title), "MNIST Viewer - image %d/%d (row %d) - predicted %c, actual %c",
+                 viewer->current_image + 1, viewer->num_visible, row + 1,
+                 predicted < 10 ? '0' + predicted : '?', actual < 10 ? '0' + actual : '?');
+    }
+    long done = prediction_feed_done();
+    int feed_rows = prediction_feed_rows();
+    if (feed_rows > 0 && done < feed_rows) {
+        size_t len = strlen(title);
+        snprintf(title + len, sizeof(title) - len, " - inference %ld%%", done * 100 / feed_rows);
+    }
+    SDL_SetWindowTitle(viewer->window, title);
+    SDL_RenderPresent(viewer->renderer);
+}
+
+// Function to visualize MNIST images. The viewer sleeps in SDL_WaitEvent()
+// and only redraws after an event, so it costs no CPU while idle. While a
+// forward pass is running it also wakes every VIEWER_REFRESH_MS to pick up
+// newly published predictions; it never waits on the workers.
+void view_mnist_images(double **data, int num_images, const int *row_labels) {
+    if ((data == NULL && data_index.offsets == NULL) || num_images <= 0) {
         fprintf(stderr, "Error: Invalid data for visualization\n");
         return;
     }
@@ -106,8 +686,9 @@ void view_mnist_images(double **data, int num_images) {
     
     // Create viewer structure
     Viewer viewer;
-    viewer.current_image = 0;
+    memset(&viewer, 0, sizeof(viewer));
     viewer.running = 1;
+    viewer.labels = row_labels;
     
     // Create window
     viewer.window = SDL_CreateWindow(
@@ -138,73 +719,96 @@ void view_mnist_images(double **data, int num_images) {
         SDL_Quit();
         return;
     }
+
+    // Nearest-neighbour scaling keeps the pixels sharp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    viewer.image = SDL_CreateTexture(viewer.renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING, 28, 28);
+    viewer.grid = SDL_CreateTexture(viewer.renderer, SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING, WINDOW_WIDTH, WINDOW_HEIGHT);
+    viewer.visible = malloc(num_images * sizeof(int));
+    if (!viewer.image || !viewer.grid || !viewer.visible) {
+        fprintf(stderr, "Error creating textures: %s\n", SDL_GetError());
+        viewer.running = 0;
+    } else {
+        viewer_filter(&viewer, num_images);
+        viewer_render(&viewer, data);
+    }
     
-    // Main loop
+    // Main loop: block until something happens, redraw only when needed
     SDL_Event event;
+    long shown_done = prediction_feed_done();
     while (viewer.running) {
-        // Process events
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
-                case SDL_QUIT:
-                    viewer.running = 0;
-                    break;
-                case SDL_KEYDOWN:
-                    switch (event.key.keysym.sym) {
-                        case SDLK_RIGHT: // Right arrow - next image
-                            viewer.current_image = (viewer.current_image + 1) % num_images;
-                            break;
-                        case SDLK_LEFT: // Left arrow - previous image
-                            viewer.current_image = (viewer.current_image - 1 + num_images) % num_images;
-                            break;
-                        case SDLK_ESCAPE: // Escape - exit
-                            viewer.running = 0;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+        int feed_rows = prediction_feed_rows();
+        int live = feed_rows > 0 && shown_done < feed_rows;
+        if (live ? !SDL_WaitEventTimeout(&event, VIEWER_REFRESH_MS) : !SDL_WaitEvent(&event)) {
+            if (!live) break;
+            // No input: refresh if the workers published more rows
+            long done = prediction_feed_done();
+            if (done != shown_done) {
+                shown_done = done;
+                if (viewer.only_errors) viewer_filter(&viewer, num_images);
+                viewer_render(&viewer, data);
             }
+            continue;
         }
-        
-        // Clear screen
-        SDL_SetRenderDrawColor(viewer.renderer, 0, 0, 0, 255);
-        SDL_RenderClear(viewer.renderer);
-        
-        // Render current image
-        double *current_data = data[viewer.current_image];
-        for (int i = 0; i < 28; i++) {
-            for (int j = 0; j < 28; j++) {
-                int index = i * 28 + j;
-                // Value is in range [0, 255], where 0 is black and 255 is white
-                int pixel_value = (int)(current_data[index]);
-                
-                // Set color (grayscale)
-                SDL_SetRenderDrawColor(viewer.renderer, pixel_value, pixel_value, pixel_value, 255);
-                
-                // Draw enlarged pixel
-                SDL_Rect rect = {
-                    j * PIXEL_SIZE,
-                    i * PIXEL_SIZE,
-                    PIXEL_SIZE,
-                    PIXEL_SIZE
-                };
-                SDL_RenderFillRect(viewer.renderer, &rect);
-            }
+        int dirty = 0;
+        int step = viewer.grid_mode ? GRID_CELLS : 1;
+        switch (event.type) {
+            case SDL_QUIT:
+                viewer.running = 0;
+                break;
+            case SDL_WINDOWEVENT:
+                dirty = (event.window.event == SDL_WINDOWEVENT_EXPOSED);
+                break;
+            case SDL_KEYDOWN:
+                dirty = 1;
+                switch (event.key.keysym.sym) {
+                    case SDLK_RIGHT: // Right arrow - next image (or page)
+                        if (viewer.num_visible > 0) {
+                            int next = viewer.current_image - viewer.current_image % step + step;
+                            viewer.current_image = (next < viewer.num_visible) ? next : 0;
+                        }
+                        break;
+                    case SDLK_LEFT: // Left arrow - previous image (or page)
+                        if (viewer.num_visible > 0) {
+                            int prev = viewer.current_image - viewer.current_image % step - step;
+                            int last = viewer.num_visible - 1;
+                            viewer.current_image = (prev >= 0) ? prev : last - last % step;
+                        }
+                        break;
+                    case SDLK_g: // Toggle grid mode, keeping the current image on screen
+                        viewer.grid_mode = !viewer.grid_mode;
+                        break;
+                    case SDLK_m: // Toggle the misclassified filter
+                        if (prediction_feed_rows() > 0 && row_labels) {
+                            viewer.only_errors = !viewer.only_errors;
+                            viewer_filter(&viewer, num_images);
+                        }
+                        break;
+                    case SDLK_ESCAPE: // Escape - exit
+                        viewer.running = 0;
+                        break;
+                    default:
+                        dirty = 0;
+                        break;
+                }
+                break;
+        }
+        if (dirty && viewer.running) {
+            viewer_render(&viewer, data);
         }
-        
-        // Show current image information
-        char info_text[100];
-        sprintf(info_text, "Image %d/%d - Use left/right arrows to navigate, ESC to exit", 
-                viewer.current_image + 1, num_images);
-        
-        // Render to screen
-        SDL_RenderPresent(viewer.renderer);
-        
-        // Small delay to avoid excessive CPU usage
-        SDL_Delay(10);
     }
     
     // Free resources
+    if (viewer_page) {
+        free_matrix(viewer_page);
+        viewer_page = NULL;
+        viewer_page_first = -1;
+    }
+    free(viewer.visible);
+    if (viewer.grid) SDL_DestroyTexture(viewer.grid);
+    if (viewer.image) SDL_DestroyTexture(viewer.image);
     SDL_DestroyRenderer(viewer.renderer);
     SDL_DestroyWindow(viewer.window);
     SDL_Quit();
@@ -242,6 +846,127 @@ char *siguiente_token(char *buffer) {
     }
 }
 
+// Allocate `bytes` of zeroed memory. Large blocks come from 2 MB pages:
+// MAP_HUGETLB if pages are reserved, else a 2 MB aligned mapping with
+// madvise(MADV_HUGEPAGE), else malloc. With hugepages_enabled = 0 large
+// blocks get an mmap with madvise(MADV_NOHUGEPAGE), so THP set to "always"
+// cannot back them with huge pages either. Release with big_free().
+void *big_alloc(size_t bytes, MemBacking *backing) {
+    size_t hdr = sizeof(BigAllocHeader);
+    BigAllocHeader *h = NULL;
+
+    if (bytes >= HUGE_ALLOC_MIN) {
+        size_t len = (bytes + hdr + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        void *p = hugepages_enabled ? mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) : MAP_FAILED;
+        if (p != MAP_FAILED) {
+            h = p;
+            h->map_start = p;
+            h->map_bytes = len;
+            h->backing = BACKING_HUGETLB;
+        }
+#endif
+        if (!h) {
+            // Over-map by one huge page and trim so the block is 2 MB aligned
+            char *raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw != MAP_FAILED) {
+                char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+                if (aligned > raw) munmap(raw, aligned - raw);
+                size_t tail = (raw + len + HUGE_PAGE_SIZE) - (aligned + len);
+                if (tail > 0) munmap(aligned + len, tail);
+                h = (BigAllocHeader *)aligned;
+                h->map_start = aligned;
+                h->map_bytes = len;
+                h->backing = BACKING_MMAP;
+#ifdef MADV_HUGEPAGE
+                if (hugepages_enabled && madvise(aligned, len, MADV_HUGEPAGE) == 0) h->backing = BACKING_THP;
+#endif
+#ifdef MADV_NOHUGEPAGE
+                if (!hugepages_enabled) madvise(aligned, len, MADV_NOHUGEPAGE);
+#endif
+            }
+        }
+    }
+    if (!h) {
+        h = calloc(1, bytes + hdr);
+        if (!h) return NULL;
+        h->map_start = NULL;
+        h->map_bytes = 0;
+        h->backing = BACKING_MALLOC;
+    }
+
+    h->bytes = bytes;
+    atomic_fetch_add(&backing_bytes[h->backing], (long)bytes);
+    if (backing) *backing = h->backing;
+    return (char *)h + hdr;
+}
+
+void big_free(void *ptr) {
+    if (!ptr) return;
+    BigAllocHeader *h = (BigAllocHeader *)((char *)ptr - sizeof(BigAllocHeader));
+    atomic_fetch_sub(&backing_bytes[h->backing], (long)h->bytes);
+    if (h->map_bytes) {
+        munmap(h->map_start, h->map_bytes);
+    } else {
+        free(h);
+    }
+}
+
+const char *backing_name(MemBacking backing) {
+    switch (backing) {
+        case BACKING_HUGETLB: return "2MB hugetlb";
+        case BACKING_THP:     return "2MB THP";
+        case BACKING_MMAP:    return "4KB mmap";
+        case BACKING_FILE:    return "file mmap";
+        default:              return "4KB malloc";
+    }
+}
+
+// Huge pages the kernel actually gave this process (AnonHugePages), in KB
+static long anon_huge_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+// Count dTLB read misses of this thread and the threads it creates afterwards.
+// Returns -1 when perf events are not available.
+int dtlb_counter_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    return fd;
+}
+
+// Stop and read the counter (inherited child counts included), then close it.
+long long dtlb_counter_read(int fd) {
+    if (fd < 0) return -1;
+    long long count = -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+    close(fd);
+    return count;
+}
+
 // Read a CSV file into a 2D matrix
 int read_matrix(double **mat, char *file, int nrows, int ncols, int fac) {
     printf("\nRead matrix from file: %s\n", file);
@@ -318,197 +1043,732 @@ int read_vector(double *vect, char *file, int nrows) {
     return 0;
 }
 
-void print_matrix(double **mat, int nrows, int ncols, int offset_row, int offset_col) {
-    if (!mat) {
-        printf("Error: The matrix is not initialized.\n");
-        return;
+// Write a 2D matrix as a space-separated CSV file (the format read_matrix reads)
+int write_matrix(double **mat, char *file, int nrows, int ncols) {
+    printf("\nWrite matrix to file: %s\n", file);
+    FILE *fstream = fopen(file, "w");
+    if (fstream == NULL) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    printf("\nMatrix (%d x %d) from offset (%d, %d):\n", nrows, ncols, offset_row, offset_col);
     for (int row = 0; row < nrows; row++) {
         for (int col = 0; col < ncols; col++) {
-            printf("%8.3f ", mat[row + offset_row][col + offset_col]);
+            fprintf(fstream, col ? " %.9g" : "%.9g", mat[row][col]);
         }
-        printf("\n");
+        fputc('\n', fstream);
     }
+    fclose(fstream);
+    return 0;
 }
 
-// Load all data and model parameters
-void load_data(char *path) {
-    // Allocate buffer for file paths.
-    str = malloc(256); // Increased buffer size for longer paths
-    
-    // Load digits
-    printf("Loading digits...\n");
-    digits = malloc(data_nrows * sizeof(double));
-    if (!digits) {
-        fprintf(stderr, "Error: Could not allocate memory for digits\n");
-        exit(1);
+// Write a vector with one value per line (the format read_vector reads)
+int write_vector(double *vect, char *file, int nrows) {
+    printf("\nWrite vector to file: %s\n", file);
+    FILE *fstream = fopen(file, "w");
+    if (fstream == NULL) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    
-    // Initialize digits array with -1 to detect loading issues
-    for (int i = 0; i < data_nrows; i++) {
-        digits[i] = -1;
+    for (int i = 0; i < nrows; i++) {
+        fprintf(fstream, "%.9g\n", vect[i]);
     }
-    
-    sprintf(str, "%scsvs/digits.csv", path);
-    if (read_vector(digits, str, data_nrows) != 0) {
-        fprintf(stderr, "Error: Could not load digits\n");
-        exit(1);
+    fclose(fstream);
+    return 0;
+}
+
+// Map a whole file read-only. Returns NULL on error.
+void *map_file(const char *file, size_t *bytes) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
     }
-    printf("Digits loaded.\n");
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    *bytes = st.st_size;
+    return p;
+}
 
-    // Allocate and load input data (as a 2D array).
-    printf("Loading data...\n");
-    data = malloc(data_nrows * sizeof(double *));
-    if (!data) {
-        fprintf(stderr, "Error: Could not allocate memory for data\n");
-        exit(1);
+static uint32_t get_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(FILE *f, uint32_t v) {
+    unsigned char b[4] = {v >> 24, v >> 16, v >> 8, v};
+    fwrite(b, 1, 4, f);
+}
+
+static const char *dataset_csv_names[DATASET_SOURCES] = {"data.csv", "digits.csv"};
+
+// Stamps of data.csv and digits.csv as they are now. Returns a bit per CSV
+// that exists; a missing one gets an all-zero stamp.
+static int dataset_stamps(char *path, SourceStamp *stamps) {
+    char file[512];
+    int present = 0;
+    for (int i = 0; i < DATASET_SOURCES; i++) {
+        struct stat st;
+        memset(&stamps[i], 0, sizeof(SourceStamp));
+        snprintf(file, sizeof(file), "%scsvs/%s", path, dataset_csv_names[i]);
+        if (stat(file, &st) != 0) continue;
+        stamps[i].file_size = st.st_size;
+        stamps[i].mtime_sec = st.st_mtim.tv_sec;
+        stamps[i].mtime_nsec = st.st_mtim.tv_nsec;
+        present |= 1 << i;
     }
-    
-    for (int i = 0; i < data_nrows; i++) {
-        data[i] = malloc(data_ncols * sizeof(double));
-        if (!data[i]) {
-            fprintf(stderr, "Error: Could not allocate memory for data[%d]\n", i);
-            exit(1);
+    return present;
+}
+
+// Whether a copy converted from the CSVs in `recorded` may stand in for
+// them. Prints which source is used and why.
+static int converted_is_current(char *path, const char *file, const SourceStamp *recorded) {
+    SourceStamp now[DATASET_SOURCES];
+    int present = dataset_stamps(path, now);
+    for (int i = 0; i < DATASET_SOURCES; i++) {
+        if (!(present & (1 << i))) continue;  // nothing newer to fall back to
+        if (memcmp(&now[i], &recorded[i], sizeof(SourceStamp)) != 0) {
+            printf("Skipping %s: %s changed since it was converted (run convert again)\n",
+                   file, dataset_csv_names[i]);
+            return 0;
         }
-        // Initialize with zeros to detect loading issues
-        for (int j = 0; j < data_ncols; j++) {
-            data[i][j] = 0;
+    }
+    printf("Using %s: %s\n", file, (present == 3) ? "converted from the current data.csv and digits.csv"
+                                                  : "a source CSV is missing, nothing newer to load");
+    return 1;
+}
+
+// Check the sidecar of a converted IDX file; a missing sidecar counts as
+// converted from unknown CSVs.
+static int idx_is_current(char *path, const char *file) {
+    char sidecar[520];
+    SourceStampFile stamps;
+    memset(&stamps, 0, sizeof(stamps));
+    snprintf(sidecar, sizeof(sidecar), "%s.src", file);
+    FILE *f = fopen(sidecar, "rb");
+    if (f) {
+        if (fread(&stamps, sizeof(stamps), 1, f) != 1 || memcmp(stamps.magic, SOURCE_STAMP_MAGIC, 8) != 0) {
+            memset(&stamps, 0, sizeof(stamps));
         }
+        fclose(f);
     }
-    
-    sprintf(str, "%scsvs/data.csv", path);
-    if (read_matrix(data, str, data_nrows, data_ncols, 1) != 0) {
-        fprintf(stderr, "Error: Could not load data.csv\n");
-        exit(1);
+    return converted_is_current(path, file, stamps.csv);
+}
+
+// Write the sidecar of a converted IDX file
+static int write_source_stamps(const char *file, const SourceStamp *stamps) {
+    SourceStampFile header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SOURCE_STAMP_MAGIC, 8);
+    memcpy(header.csv, stamps, sizeof(header.csv));
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    
-    printf("Data loaded.\n");
-    print_matrix(data, 5, 5, 0, 0);
-    
-    // Check if data is loaded correctly by examining a few values
-    int has_nonzero = 0;
-    for (int i = 0; i < 5 && i < data_nrows; i++) {
-        for (int j = 0; j < 5 && j < data_ncols; j++) {
-            if (data[i][j] != 0) {
-                has_nonzero = 1;
-                break;
-            }
-        }
-        if (has_nonzero) break;
+    int failed = fwrite(&header, sizeof(header), 1, f) != 1;
+    fclose(f);
+    return failed;
+}
+
+// Read an IDX3 ubyte image file (magic 0x00000803, n x rows x cols) into a matrix
+int read_idx_images(double **mat, char *file, int nrows, int ncols) {
+    printf("\nRead IDX images from file: %s\n", file);
+    size_t bytes;
+    unsigned char *p = map_file(file, &bytes);
+    if (!p) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    if (!has_nonzero) {
-        printf("Warning: The data seems to contain only zeros. Check the CSV file format\n");
+    if (bytes < 16 || get_be32(p) != 0x00000803 ||
+        (size_t)get_be32(p + 8) * get_be32(p + 12) != (size_t)ncols) {
+        printf("Error: %s is not an IDX3 file of %d-pixel images\n", file, ncols);
+        munmap(p, bytes);
+        return 1;
     }
-    
-    // Load weight matrices.
-    // mat1: 784 x 200
-    printf("Loading mat1...\n");
-    mat1 = malloc(matrices_rows[0] * sizeof(double *));
-    for (int i = 0; i < matrices_rows[0]; i++) {
-        mat1[i] = malloc(matrices_columns[0] * sizeof(double));
-        for (int j = 0; j < matrices_columns[0]; j++) {
-            mat1[i][j] = 0;
+    int count = get_be32(p + 4);
+    if ((size_t)count * ncols + 16 > bytes) count = (bytes - 16) / ncols;
+    if (count < nrows) {
+        printf("Warning: Reached end of file at row %d/%d\n", count, nrows);
+    }
+    madvise(p, bytes, MADV_SEQUENTIAL);
+    const unsigned char *pixels = p + 16;
+    for (int row = 0; row < nrows && row < count; row++) {
+        for (int col = 0; col < ncols; col++) {
+            mat[row][col] = pixels[(size_t)row * ncols + col];
         }
     }
-    sprintf(str, "%sparameters/weights%d_%d.csv", path, 0, seed);
-    read_matrix(mat1, str, matrices_rows[0], matrices_columns[0], 1);
-    printf("mat1 loaded.\n");
+    munmap(p, bytes);
+    return 0;
+}
 
-    // mat2: 200 x 100
-    printf("Loading mat2...\n");
-    mat2 = malloc(matrices_rows[1] * sizeof(double *));
-    for (int i = 0; i < matrices_rows[1]; i++) {
-        mat2[i] = malloc(matrices_columns[1] * sizeof(double));
-        for (int j = 0; j < matrices_columns[1]; j++) {
-            mat2[i][j] = 0;
-        }
+// Read an IDX1 ubyte label file (magic 0x00000801) into a vector
+int read_idx_labels(double *vect, char *file, int nrows) {
+    printf("\nRead IDX labels from file: %s\n", file);
+    size_t bytes;
+    unsigned char *p = map_file(file, &bytes);
+    if (!p) {
+        printf("Error opening file: %s\n", file);
+        return 1;
+    }
+    if (bytes < 8 || get_be32(p) != 0x00000801) {
+        printf("Error: %s is not an IDX1 label file\n", file);
+        munmap(p, bytes);
+        return 1;
+    }
+    int count = get_be32(p + 4);
+    if ((size_t)count + 8 > bytes) count = bytes - 8;
+    if (count < nrows) {
+        printf("Warning: Reached end of file at row %d/%d\n", count, nrows);
     }
-    sprintf(str, "%sparameters/weights%d_%d.csv", path, 1, seed);
-    read_matrix(mat2, str, matrices_rows[1], matrices_columns[1], 1);
-    printf("mat2 loaded.\n");
+    for (int i = 0; i < nrows && i < count; i++) {
+        vect[i] = p[8 + i];
+    }
+    munmap(p, bytes);
+    return 0;
+}
 
-    // mat3: 100 x 50
-    printf("Loading mat3...\n");
-    mat3 = malloc(matrices_rows[2] * sizeof(double *));
-    for (int i = 0; i < matrices_rows[2]; i++) {
-        mat3[i] = malloc(matrices_columns[2] * sizeof(double));
-        for (int j = 0; j < matrices_columns[2]; j++) {
-            mat3[i][j] = 0;
-        }
+// Write a matrix of 0-255 pixels as an IDX3 ubyte file (28x28 images)
+int write_idx_images(double **mat, char *file, int nrows, int ncols) {
+    printf("\nWrite IDX images to file: %s\n", file);
+    FILE *fstream = fopen(file, "wb");
+    if (fstream == NULL) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    sprintf(str, "%sparameters/weights%d_%d.csv", path, 2, seed);
-    read_matrix(mat3, str, matrices_rows[2], matrices_columns[2], 1);
-    printf("mat3 loaded.\n");
-    
-    // mat4: 50 x 10
-    printf("Loading mat4...\n");
-    mat4 = malloc(matrices_rows[3] * sizeof(double *));
-    for (int i = 0; i < matrices_rows[3]; i++) {
-        mat4[i] = malloc(matrices_columns[3] * sizeof(double));
-        for (int j = 0; j < matrices_columns[3]; j++) {
-            mat4[i][j] = 0;
+    int side = (int)(sqrt(ncols) + 0.5);
+    put_be32(fstream, 0x00000803);
+    put_be32(fstream, nrows);
+    put_be32(fstream, side);
+    put_be32(fstream, ncols / side);
+    int clipped = 0;
+    unsigned char *buffer = malloc(ncols);
+    for (int row = 0; row < nrows; row++) {
+        for (int col = 0; col < ncols; col++) {
+            double v = mat[row][col];
+            if (v < 0 || v > 255 || v != (int)v) clipped++;
+            buffer[col] = (v < 0) ? 0 : (v > 255) ? 255 : (unsigned char)(v + 0.5);
         }
+        fwrite(buffer, 1, ncols, fstream);
     }
-    sprintf(str, "%sparameters/weights%d_%d.csv", path, 3, seed);
-    read_matrix(mat4, str, matrices_rows[3], matrices_columns[3], 1);
-    printf("mat4 loaded.\n");
-
-    // Load bias vectors.
-    // vec1: dimension 200
-    vec1 = malloc(vector_rows[0] * sizeof(double));
-    for (int i = 0; i < vector_rows[0]; i++) {
-        vec1[i] = 0;
+    free(buffer);
+    fclose(fstream);
+    if (clipped > 0) {
+        printf("Warning: %d values were not integers in [0, 255] and were rounded\n", clipped);
     }
-    sprintf(str, "%sparameters/biases%d_%d.csv", path, 0, seed);
-    read_vector(vec1, str, vector_rows[0]);
-    printf("vec1 loaded.\n");
+    return 0;
+}
 
-    // vec2: dimension 100
-    vec2 = malloc(vector_rows[1] * sizeof(double));
-    for (int i = 0; i < vector_rows[1]; i++) {
-        vec2[i] = 0;
+// Write a label vector as an IDX1 ubyte file
+int write_idx_labels(double *vect, char *file, int nrows) {
+    printf("\nWrite IDX labels to file: %s\n", file);
+    FILE *fstream = fopen(file, "wb");
+    if (fstream == NULL) {
+        printf("Error opening file: %s\n", file);
+        return 1;
     }
-    sprintf(str, "%sparameters/biases%d_%d.csv", path, 1, seed);
-    read_vector(vec2, str, vector_rows[1]);
-    printf("vec2 loaded.\n");
-
-    // vec3: dimension 50
-    vec3 = malloc(vector_rows[2] * sizeof(double));
-    for (int i = 0; i < vector_rows[2]; i++) {
-        vec3[i] = 0;
+    put_be32(fstream, 0x00000801);
+    put_be32(fstream, nrows);
+    for (int i = 0; i < nrows; i++) {
+        fputc((vect[i] < 0) ? 0 : (int)vect[i], fstream);
     }
-    sprintf(str, "%sparameters/biases%d_%d.csv", path, 2, seed);
-    read_vector(vec3, str, vector_rows[2]);
-    printf("vec3 loaded.\n");
-    // debug_print_vector(vec3, vector_rows[2], "vec3");
+    fclose(fstream);
+    return 0;
+}
 
-    // vec4: dimension 10
-    vec4 = malloc(vector_rows[3] * sizeof(double));
-    for (int i = 0; i < vector_rows[3]; i++) {
-        vec4[i] = 0;
+// Write the dataset as our binary dump: DataBinHeader + native doubles,
+// stamped with the CSVs it was converted from
+int write_data_bin(double **mat, char *file, int nrows, int ncols, const SourceStamp *stamps) {
+    printf("\nWrite binary dataset to file: %s\n", file);
+    FILE *fstream = fopen(file, "wb");
+    if (fstream == NULL) {
+        printf("Error opening file: %s\n", file);
+        return 1;
+    }
+    DataBinHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATA_BIN_MAGIC, 8);
+    header.nrows = nrows;
+    header.ncols = ncols;
+    header.elem_size = sizeof(double);
+    memcpy(header.csv, stamps, sizeof(header.csv));
+    fwrite(&header, sizeof(header), 1, fstream);
+    for (int row = 0; row < nrows; row++) {
+        fwrite(mat[row], sizeof(double), ncols, fstream);
+    }
+    fclose(fstream);
+    return 0;
+}
+
+// Map csvs/data.bin and point the rows of `data` straight into it, unless
+// it is older than the CSVs.
+static int map_data_bin(char *path, char *file) {
+    size_t bytes;
+    DataBinHeader *header = map_file(file, &bytes);
+    if (!header) {
+        printf("Error opening file: %s\n", file);
+        return 1;
+    }
+    if (bytes < sizeof(DataBinHeader) || memcmp(header->magic, DATA_BIN_MAGIC, 8) != 0 ||
+        header->ncols != (uint32_t)data_ncols || header->elem_size != sizeof(double) ||
+        header->nrows < (uint32_t)data_nrows ||
+        bytes < sizeof(DataBinHeader) + (size_t)header->nrows * data_ncols * sizeof(double)) {
+        printf("Error: %s does not hold %d rows of %d doubles\n", file, data_nrows, data_ncols);
+        munmap(header, bytes);
+        return 1;
+    }
+    if (!converted_is_current(path, file, header->csv)) {
+        munmap(header, bytes);
+        return 1;
+    }
+    double *rows = (double *)(header + 1);
+    data = malloc(data_nrows * sizeof(double *));
+    for (int i = 0; i < data_nrows; i++) {
+        data[i] = rows + (size_t)i * data_ncols;
+    }
+    data_map = header;
+    data_map_bytes = bytes;
+    data_backing = BACKING_FILE;
+    return 0;
+}
+
+// Move a finished `<file>.tmp` over `file`. The dataset may have been loaded
+// by mapping `file`, so it is never truncated in place.
+static int replace_file(const char *tmp, const char *file) {
+    if (rename(tmp, file) != 0) {
+        printf("Error: Could not replace %s: %s\n", file, strerror(errno));
+        remove(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+// Write the loaded dataset as IDX (data.idx, digits.idx) and as our binary dump (data.bin).
+void convert_dataset(char *path) {
+    char file[512], tmp[520], sidecar[520], sidecar_tmp[530];
+    SourceStamp stamps[DATASET_SOURCES];
+    int failed = 0;
+    dataset_stamps(path, stamps);
+    sprintf(file, "%scsvs/data.idx", path);
+    sprintf(tmp, "%s.tmp", file);
+    sprintf(sidecar, "%s.src", file);
+    sprintf(sidecar_tmp, "%s.tmp", sidecar);
+    failed |= write_idx_images(data, tmp, data_nrows, data_ncols) || write_source_stamps(sidecar_tmp, stamps) ||
+              replace_file(tmp, file) || replace_file(sidecar_tmp, sidecar);
+    sprintf(file, "%scsvs/digits.idx", path);
+    sprintf(tmp, "%s.tmp", file);
+    sprintf(sidecar, "%s.src", file);
+    sprintf(sidecar_tmp, "%s.tmp", sidecar);
+    failed |= write_idx_labels(digits, tmp, data_nrows) || write_source_stamps(sidecar_tmp, stamps) ||
+              replace_file(tmp, file) || replace_file(sidecar_tmp, sidecar);
+    sprintf(file, "%scsvs/data.bin", path);
+    sprintf(tmp, "%s.tmp", file);
+    failed |= write_data_bin(data, tmp, data_nrows, data_ncols, stamps) || replace_file(tmp, file);
+    if (failed) {
+        fprintf(stderr, "Error: Could not write the converted dataset\n");
+        exit(1);
+    }
+    printf("\nDataset converted: later runs load csvs/data.bin (or data.idx) and csvs/digits.idx.\n");
+}
+
+// Per-thread part of the row index build: count the rows starting in
+// [begin, end), then (second pass) write their offsets from `first_row` on.
+typedef struct {
+    const char *map;
+    size_t size;
+    size_t begin;
+    size_t end;
+    int count;
+    int first_row;
+    uint64_t *offsets;
+} RowScanData;
+
+static void *row_scan_thread(void *arg) {
+    RowScanData *rs = (RowScanData *)arg;
+    int row = rs->first_row;
+    int count = 0;
+    // A row starts at 0 and after every '\n' that is not the last byte
+    size_t pos = rs->begin;
+    if (pos == 0 && rs->size > 0) {
+        if (rs->offsets) rs->offsets[row++] = 0;
+        count++;
+    }
+    while (pos < rs->end) {
+        const char *nl = memchr(rs->map + pos, '\n', rs->end - pos);
+        if (!nl) break;
+        pos = nl - rs->map + 1;
+        if (pos < rs->size) {
+            if (rs->offsets) rs->offsets[row++] = pos;
+            count++;
+        }
+    }
+    rs->count = count;
+    return NULL;
+}
+
+// Build the row offsets with a parallel two-pass scan of the mapped file.
+static int row_index_build(RowIndex *index) {
+    extern int thread_count;
+    int nthreads = (thread_count > 0) ? thread_count : 1;
+    RowScanData *rs = calloc(nthreads, sizeof(RowScanData));
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+
+    for (int pass = 0; pass < 2; pass++) {
+        int row = 0;
+        for (int t = 0; t < nthreads; t++) {
+            rs[t].map = index->map;
+            rs[t].size = index->map_bytes;
+            rs[t].begin = index->map_bytes * t / nthreads;
+            rs[t].end = index->map_bytes * (t + 1) / nthreads;
+            rs[t].first_row = row;
+            rs[t].offsets = index->offsets;
+            if (pass == 1) row += rs[t].count;
+            pthread_create(&threads[t], NULL, row_scan_thread, &rs[t]);
+        }
+        for (int t = 0; t < nthreads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        if (pass == 0) {
+            index->nrows = 0;
+            for (int t = 0; t < nthreads; t++) {
+                index->nrows += rs[t].count;
+            }
+            index->offsets = malloc((index->nrows + 1) * sizeof(uint64_t));
+            if (!index->offsets) {
+                free(rs);
+                free(threads);
+                return 1;
+            }
+        }
+    }
+    index->offsets[index->nrows] = index->map_bytes;
+    free(rs);
+    free(threads);
+    return 0;
+}
+
+// Open the row index of a CSV file: reuse its sidecar file when the CSV's
+// size and mtime still match, otherwise build it and write the sidecar.
+int row_index_open(RowIndex *index, char *csv_file) {
+    char sidecar[512];
+    struct stat st;
+    memset(index, 0, sizeof(*index));
+    if (stat(csv_file, &st) != 0) {
+        printf("Error opening file: %s\n", csv_file);
+        return 1;
+    }
+    index->map = map_file(csv_file, &index->map_bytes);
+    if (!index->map) {
+        printf("Error opening file: %s\n", csv_file);
+        return 1;
+    }
+    madvise(index->map, index->map_bytes, MADV_RANDOM);
+    snprintf(sidecar, sizeof(sidecar), "%s.rows", csv_file);
+
+    FILE *f = fopen(sidecar, "rb");
+    if (f) {
+        RowIndexHeader header;
+        if (fread(&header, sizeof(header), 1, f) == 1 &&
+            memcmp(header.magic, ROW_INDEX_MAGIC, 8) == 0 &&
+            header.file_size == (uint64_t)st.st_size &&
+            header.mtime_sec == (int64_t)st.st_mtim.tv_sec &&
+            header.mtime_nsec == (int64_t)st.st_mtim.tv_nsec) {
+            index->nrows = header.nrows;
+            index->offsets = malloc((index->nrows + 1) * sizeof(uint64_t));
+            if (index->offsets &&
+                fread(index->offsets, sizeof(uint64_t), index->nrows + 1, f) == (size_t)index->nrows + 1) {
+                fclose(f);
+                printf("Row index loaded from %s (%d rows)\n", sidecar, index->nrows);
+                return 0;
+            }
+            free(index->offsets);
+            index->offsets = NULL;
+        }
+        fclose(f);
+    }
+
+    TimingInfo timing;
+    start_timing(&timing, "Row index build");
+    if (row_index_build(index) != 0) {
+        row_index_close(index);
+        return 1;
+    }
+    end_timing(&timing);
+    printf("Row index built for %s (%d rows, %.4f s)\n", csv_file, index->nrows, timing.elapsed_time);
+
+    f = fopen(sidecar, "wb");
+    if (f) {
+        RowIndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ROW_INDEX_MAGIC, 8);
+        header.file_size = st.st_size;
+        header.mtime_sec = st.st_mtim.tv_sec;
+        header.mtime_nsec = st.st_mtim.tv_nsec;
+        header.nrows = index->nrows;
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(index->offsets, sizeof(uint64_t), index->nrows + 1, f);
+        fclose(f);
+    } else {
+        printf("Warning: Could not write the row index %s\n", sidecar);
+    }
+    return 0;
+}
+
+// Parse rows [first, first + count) of the indexed CSV into out.
+int row_index_read_rows(RowIndex *index, int first, int count, double **out) {
+    char buffer[1024 * 10];
+    if (first < 0 || first + count > index->nrows) return 1;
+    for (int r = 0; r < count; r++) {
+        uint64_t begin = index->offsets[first + r];
+        size_t len = index->offsets[first + r + 1] - begin;
+        if (len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+        memcpy(buffer, index->map + begin, len);
+        buffer[len] = '\0';
+
+        char *token = siguiente_token(buffer);
+        for (int col = 0; col < data_ncols; col++) {
+            out[r][col] = token ? strtod(token, NULL) : 0.0;
+            if (token) token = siguiente_token(NULL);
+        }
+    }
+    return 0;
+}
+
+void row_index_close(RowIndex *index) {
+    if (index->map) munmap(index->map, index->map_bytes);
+    free(index->offsets);
+    memset(index, 0, sizeof(*index));
+}
+
+// Image rows for the viewer: the loaded dataset, or pages of rows parsed on
+// demand through the row index.
+double *viewer_row(double **data, int index) {
+    if (data) return data[index];
+    if (!viewer_page) viewer_page = alloc_matrix(VIEWER_PAGE_ROWS, data_ncols);
+    if (viewer_page_first < 0 || index < viewer_page_first || index >= viewer_page_first + VIEWER_PAGE_ROWS) {
+        int first = index - index % VIEWER_PAGE_ROWS;
+        int count = (data_index.nrows - first < VIEWER_PAGE_ROWS) ? data_index.nrows - first : VIEWER_PAGE_ROWS;
+        row_index_read_rows(&data_index, first, count, viewer_page);
+        viewer_page_first = first;
+    }
+    return viewer_page[index - viewer_page_first];
+}
+
+void print_matrix(double **mat, int nrows, int ncols, int offset_row, int offset_col) {
+    if (!mat) {
+        printf("Error: The matrix is not initialized.\n");
+        return;
+    }
+    printf("\nMatrix (%d x %d) from offset (%d, %d):\n", nrows, ncols, offset_row, offset_col);
+    for (int row = 0; row < nrows; row++) {
+        for (int col = 0; col < ncols; col++) {
+            printf("%8.3f ", mat[row + offset_row][col + offset_col]);
+        }
+        printf("\n");
+    }
+}
+
+// Load all data and model parameters
+void load_data(char *path) {
+    // Allocate buffer for file paths.
+    str = malloc(256); // Increased buffer size for longer paths
+
+    load_digits(path);
+    load_images(path);
+    load_parameters(path);
+}
+
+// Load labels and model parameters only; image rows are read on demand
+// through the row index of data.csv (or the mapping of data.bin).
+void load_data_lazy(char *path) {
+    str = malloc(256);
+
+    load_digits(path);
+    sprintf(str, "%scsvs/data.bin", path);
+    if (access(str, R_OK) == 0 && map_data_bin(path, str) == 0) {
+        // Already random access, no parsing
+        printf("Data buffer backing: %s (%s)\n", backing_name(data_backing), str);
+    } else {
+        sprintf(str, "%scsvs/data.csv", path);
+        if (row_index_open(&data_index, str) != 0) {
+            fprintf(stderr, "Error: Could not index %s\n", str);
+            exit(1);
+        }
+    }
+    load_parameters(path);
+}
+
+// Load the ground truth labels
+static void load_digits(char *path) {
+    printf("Loading digits...\n");
+    digits = malloc(data_nrows * sizeof(double));
+    if (!digits) {
+        fprintf(stderr, "Error: Could not allocate memory for digits\n");
+        exit(1);
+    }
+    
+    // Initialize digits array with -1 to detect loading issues
+    for (int i = 0; i < data_nrows; i++) {
+        digits[i] = -1;
+    }
+    
+    // IDX labels replace digits.csv when present
+    sprintf(str, "%scsvs/digits.idx", path);
+    int labels_failed = -1;
+    if (access(str, R_OK) == 0 && idx_is_current(path, str)) {
+        labels_failed = read_idx_labels(digits, str, data_nrows);
+    }
+    if (labels_failed != 0) {
+        sprintf(str, "%scsvs/digits.csv", path);
+        printf("Using %s\n", str);
+        labels_failed = read_vector(digits, str, data_nrows);
+    }
+    if (labels_failed != 0) {
+        fprintf(stderr, "Error: Could not load digits\n");
+        exit(1);
+    }
+    labels = malloc(data_nrows * sizeof(int));
+    for (int i = 0; i < data_nrows; i++) {
+        labels[i] = (int)digits[i];
+    }
+    printf("Digits loaded.\n");
+}
+
+// Load the input images
+static void load_images(char *path) {
+    // Load input data (as a 2D array). Preference: our binary dump (used in
+    // place through mmap), then IDX images, then data.csv.
+    printf("Loading data...\n");
+    sprintf(str, "%scsvs/data.bin", path);
+    if (access(str, R_OK) != 0 || map_data_bin(path, str) != 0) {
+        // Zero-initialized so loading issues show up as empty rows
+        data = malloc(data_nrows * sizeof(double *));
+        double *block = big_alloc((size_t)data_nrows * data_ncols * sizeof(double), &data_backing);
+        if (!data || !block) {
+            fprintf(stderr, "Error: Could not allocate memory for data\n");
+            exit(1);
+        }
+        for (int i = 0; i < data_nrows; i++) {
+            data[i] = block + (size_t)i * data_ncols;
+        }
+
+        sprintf(str, "%scsvs/data.idx", path);
+        int data_failed = -1;
+        if (access(str, R_OK) == 0 && idx_is_current(path, str)) {
+            data_failed = read_idx_images(data, str, data_nrows, data_ncols);
+        }
+        if (data_failed != 0) {
+            sprintf(str, "%scsvs/data.csv", path);
+            printf("Using %s\n", str);
+            data_failed = read_matrix(data, str, data_nrows, data_ncols, 1);
+        }
+        if (data_failed != 0) {
+            fprintf(stderr, "Error: Could not load %s\n", str);
+            exit(1);
+        }
+    }
+    printf("Data buffer backing: %s (%s)\n", backing_name(data_backing), str);
+    
+    printf("Data loaded.\n");
+    print_matrix(data, 5, 5, 0, 0);
+    
+    // Check if data is loaded correctly by examining a few values
+    int has_nonzero = 0;
+    for (int i = 0; i < 5 && i < data_nrows; i++) {
+        for (int j = 0; j < 5 && j < data_ncols; j++) {
+            if (data[i][j] != 0) {
+                has_nonzero = 1;
+                break;
+            }
+        }
+        if (has_nonzero) break;
+    }
+    if (!has_nonzero) {
+        printf("Warning: The data seems to contain only zeros. Check the CSV file format\n");
+    }
+}
+
+// Load the parameters for `seed`
+static void load_parameters(char *path) {
+    // Load weight matrices and bias vectors.
+    if (load_model(&base_model, path, seed) != 0) {
+        fprintf(stderr, "Error: Could not load the model parameters\n");
+        exit(1);
+    }
+    mat1 = base_model.weights[0];
+    mat2 = base_model.weights[1];
+    mat3 = base_model.weights[2];
+    mat4 = base_model.weights[3];
+    vec1 = base_model.biases[0];
+    vec2 = base_model.biases[1];
+    vec3 = base_model.biases[2];
+    vec4 = base_model.biases[3];
+
+    base_live.model = &base_model;
+    base_live.generation = 0;
+    base_live.owned = 0;
+    atomic_store(&base_live.refs, 1);
+    atomic_store(&base_live.rows_served, 0);
+    atomic_store(&live_model, &base_live);
+}
+
+// Load the four weight matrices and bias vectors of one seed.
+// mat1: 784 x 200, mat2: 200 x 100, mat3: 100 x 50, mat4: 50 x 10.
+int load_model(Model *model, char *path, int seed) {
+    char file[512];
+    model->seed = seed;
+    for (int layer = 0; layer < 4; layer++) {
+        printf("Loading mat%d (seed %d)...\n", layer + 1, seed);
+        model->weights[layer] = alloc_matrix(matrices_rows[layer], matrices_columns[layer]);
+        model->biases[layer] = calloc(vector_rows[layer], sizeof(double));
+        if (!model->weights[layer] || !model->biases[layer]) {
+            fprintf(stderr, "Error: Could not allocate memory for layer %d\n", layer);
+            exit(1);
+        }
+        sprintf(file, "%sparameters/weights%d_%d.csv", path, layer, seed);
+        if (read_matrix(model->weights[layer], file, matrices_rows[layer], matrices_columns[layer], 1) != 0) {
+            return 1;
+        }
+        printf("mat%d loaded.\n", layer + 1);
+
+        sprintf(file, "%sparameters/biases%d_%d.csv", path, layer, seed);
+        if (read_vector(model->biases[layer], file, vector_rows[layer]) != 0) {
+            return 1;
+        }
+        printf("vec%d loaded.\n", layer + 1);
+    }
+    return 0;
+}
+
+// Free the parameters of a model.
+void unload_model(Model *model) {
+    for (int layer = 0; layer < 4; layer++) {
+        if (model->weights[layer]) free_matrix(model->weights[layer]);
+        free(model->biases[layer]);
+        model->weights[layer] = NULL;
+        model->biases[layer] = NULL;
     }
-    sprintf(str, "%sparameters/biases%d_%d.csv", path, 3, seed);
-    read_vector(vec4, str, vector_rows[3]);
-    printf("vec4 loaded.\n");
-    // debug_print_vector(vec4, vector_rows[3], "vec4");
 }
 
 // Free all allocated memory.
 void unload_data() {
+    prediction_feed_free();
     free(digits);
-    for (int i = 0; i < data_nrows; i++) {
-        free(data[i]);
-    }
-    free(data);
-    free_matrix(mat1, matrices_rows[0]);
-    free_matrix(mat2, matrices_rows[1]);
-    free_matrix(mat3, matrices_rows[2]);
-    free_matrix(mat4, matrices_rows[3]);
-    free(vec1);
-    free(vec2);
-    free(vec3);
-    free(vec4);
+    free(labels);
+    tally_free(&eval_result);
+    if (data_map) {
+        munmap(data_map, data_map_bytes);
+        free(data);
+        data_map = NULL;
+    } else if (data) {
+        free_matrix(data);
+    }
+    data = NULL;
+    row_index_close(&data_index);
+    LiveModel *live = atomic_exchange(&live_model, NULL);
+    if (live && live->owned) model_release(live);  // no readers are left at exit
+    unload_model(&base_model);
     free(str);
 }
 
@@ -519,15 +1779,25 @@ void print(void *arg) { printf("Hello, I am %d\n", *(int *)arg); }
 // - weights: (input_cols x weight_cols)
 // Result: (input_rows x weight_cols)
 double** mat_mul(double **input, int input_rows, int input_cols, double **weights, int weight_cols) {
-    double **result = malloc(input_rows * sizeof(double *));
-    for (int i = 0; i < input_rows; i++) {
-        result[i] = malloc(weight_cols * sizeof(double));
-    }
-    for (int i = 0; i < input_rows; i++) {
-        for (int j = 0; j < weight_cols; j++) {
-            result[i][j] = 0;
-            for (int k = 0; k < input_cols; k++) {
-                result[i][j] += input[i][k] * weights[k][j];
+    double **result = alloc_matrix(input_rows, weight_cols);
+    if (!result) return NULL;
+    memset(result[0], 0, (size_t)input_rows * weight_cols * sizeof(double));
+    // Blocked i-k-j order: a tile of input rows reuses the same band of weight
+    // rows while it is in cache. Each sum still runs over k in order, so the
+    // result does not depend on the tile shape.
+    for (int ii = 0; ii < input_rows; ii += matmul_tile_rows) {
+        int i_end = (ii + matmul_tile_rows < input_rows) ? ii + matmul_tile_rows : input_rows;
+        for (int kk = 0; kk < input_cols; kk += matmul_tile_k) {
+            int k_end = (kk + matmul_tile_k < input_cols) ? kk + matmul_tile_k : input_cols;
+            for (int i = ii; i < i_end; i++) {
+                double *out = result[i];
+                for (int k = kk; k < k_end; k++) {
+                    double a = input[i][k];
+                    const double *w = weights[k];
+                    for (int j = 0; j < weight_cols; j++) {
+                        out[j] += a * w[j];
+                    }
+                }
             }
         }
     }
@@ -572,14 +1842,44 @@ int* argmax(double **matrix, int rows, int cols) {
     return predictions;
 }
 
-// Free a 2D matrix.
-void free_matrix(double **matrix, int rows) {
-    for (int i = 0; i < rows; i++) {
-        free(matrix[i]);
-    }
+// Free a 2D matrix allocated by alloc_matrix(). Only that layout is
+// accepted: the rows are one block starting at matrix[0].
+void free_matrix(double **matrix) {
+    if (!matrix) return;
+    big_free(matrix[0]);
     free(matrix);
 }
 
+// Allocate a zero-initialized 2D matrix. The rows share one contiguous block
+// from big_alloc(), so large matrices get huge pages.
+double** alloc_matrix(int nrows, int ncols) {
+    double **matrix = malloc((nrows > 0 ? nrows : 1) * sizeof(double *));
+    if (!matrix) return NULL;
+    double *block = big_alloc((size_t)nrows * ncols * sizeof(double), NULL);
+    if (!block) {
+        free(matrix);
+        return NULL;
+    }
+    matrix[0] = block;
+    for (int i = 1; i < nrows; i++) {
+        matrix[i] = block + (size_t)i * ncols;
+    }
+    return matrix;
+}
+
+// Layer 0 product: input (rows x 784) * W0 (784 x 200). With a low-rank
+// factorization of base_model loaded it runs as two thin GEMMs instead.
+double** layer0_mat_mul(double **input, int rows, const Model *model) {
+    if (lowrank_rank <= 0 || model != &base_model) {
+        return mat_mul(input, rows, data_ncols, model->weights[0], matrices_columns[0]);
+    }
+    double **thin = mat_mul(input, rows, data_ncols, mat1_a, lowrank_rank);
+    if (!thin) return NULL;
+    double **result = mat_mul(thin, rows, lowrank_rank, mat1_b, matrices_columns[0]);
+    free_matrix(thin);
+    return result;
+}
+
 // Perform the forward pass through the network.
 int* forward_pass(double **data) {
     double **capa0, **capa1, **capa2, **capa3;
@@ -589,7 +1889,7 @@ int* forward_pass(double **data) {
     
     // Layer 0: data (data_nrows x 784) * mat1 (784 x 200)
     printf("\n--- Layer 0 ---\n");
-    capa0 = mat_mul(data, data_nrows, data_ncols, mat1, matrices_columns[0]);
+    capa0 = layer0_mat_mul(data, data_nrows, &base_model);
     capa0 = sum_vect(capa0, vec1, data_nrows, matrices_columns[0]);
     capa0 = relu(capa0, data_nrows, matrices_columns[0]);
     printf("Layer 0 complete. Output shape: [%d x %d]\n", data_nrows, matrices_columns[0]);
@@ -600,7 +1900,7 @@ int* forward_pass(double **data) {
     capa1 = sum_vect(capa1, vec2, data_nrows, matrices_columns[1]);
     capa1 = relu(capa1, data_nrows, matrices_columns[1]);
     printf("Layer 1 complete. Output shape: [%d x %d]\n", data_nrows, matrices_columns[1]);
-    free_matrix(capa0, data_nrows);
+    free_matrix(capa0);
     
     // Layer 2: capa1 (data_nrows x 100) * mat3 (100 x 50)
     printf("\n--- Layer 2 ---\n");
@@ -608,7 +1908,7 @@ int* forward_pass(double **data) {
     capa2 = sum_vect(capa2, vec3, data_nrows, matrices_columns[2]);
     capa2 = relu(capa2, data_nrows, matrices_columns[2]);
     printf("Layer 2 complete. Output shape: [%d x %d]\n", data_nrows, matrices_columns[2]);
-    free_matrix(capa1, data_nrows);
+    free_matrix(capa1);
     
     // Layer 3: capa2 (data_nrows x 50) * mat4 (50 x 10)
     printf("\n--- Layer 3 (Final Layer) ---\n");
@@ -616,7 +1916,7 @@ int* forward_pass(double **data) {
     capa3 = sum_vect(capa3, vec4, data_nrows, matrices_columns[3]);
     capa3 = relu(capa3, data_nrows, matrices_columns[3]);
     printf("Layer 3 complete. Output shape: [%d x %d]\n", data_nrows, matrices_columns[3]);
-    free_matrix(capa2, data_nrows);
+    free_matrix(capa2);
     
     // Compute predictions using argmax.
     printf("\n--- Computing Final Predictions ---\n");
@@ -629,7 +1929,7 @@ int* forward_pass(double **data) {
         printf("Sample %d: Predicted digit %d\n", i, predicciones[i]);
     }
     
-    free_matrix(capa3, data_nrows);
+    free_matrix(capa3);
     printf("\n=== Forward Pass Complete ===\n");
     
     return predicciones;
@@ -640,116 +1940,582 @@ int thread_forward(void *arg) {
     ThreadData *td = (ThreadData *)arg;
     int rows = td->end - td->start;
     double **layer0 = NULL, **layer1 = NULL, **layer2 = NULL, **layer3 = NULL;
-    int *local_preds = NULL;
+    const Model *model = td->model ? td->model : &base_model;
 
     // Layer 0
-    layer0 = mat_mul(td->input_data + td->start, rows, data_ncols, mat1, matrices_columns[0]);
+    layer0 = layer0_mat_mul(td->input_data + td->start, rows, model);
     if (!layer0) return 1;
-    layer0 = sum_vect(layer0, vec1, rows, matrices_columns[0]);
+    layer0 = sum_vect(layer0, model->biases[0], rows, matrices_columns[0]);
     layer0 = relu(layer0, rows, matrices_columns[0]);
 
     // Layer 1
-    layer1 = mat_mul(layer0, rows, matrices_columns[0], mat2, matrices_columns[1]);
+    layer1 = mat_mul(layer0, rows, matrices_columns[0], model->weights[1], matrices_columns[1]);
     if (!layer1) { 
-        free_matrix(layer0, rows);
+        free_matrix(layer0);
         return 1;
     }
-    layer1 = sum_vect(layer1, vec2, rows, matrices_columns[1]);
+    layer1 = sum_vect(layer1, model->biases[1], rows, matrices_columns[1]);
     layer1 = relu(layer1, rows, matrices_columns[1]);
-    free_matrix(layer0, rows);
+    free_matrix(layer0);
     layer0 = NULL;
 
     // Layer 2
-    layer2 = mat_mul(layer1, rows, matrices_columns[1], mat3, matrices_columns[2]);
+    layer2 = mat_mul(layer1, rows, matrices_columns[1], model->weights[2], matrices_columns[2]);
     if (!layer2) {
-        free_matrix(layer1, rows);
+        free_matrix(layer1);
         return 1;
     }
-    layer2 = sum_vect(layer2, vec3, rows, matrices_columns[2]);
+    layer2 = sum_vect(layer2, model->biases[2], rows, matrices_columns[2]);
     layer2 = relu(layer2, rows, matrices_columns[2]);
-    free_matrix(layer1, rows);
+    free_matrix(layer1);
     layer1 = NULL;
 
     // Layer 3 (final layer)
-    layer3 = mat_mul(layer2, rows, matrices_columns[2], mat4, matrices_columns[3]);
+    layer3 = mat_mul(layer2, rows, matrices_columns[2], model->weights[3], matrices_columns[3]);
     if (!layer3) {
-        free_matrix(layer2, rows);
+        free_matrix(layer2);
         return 1;
     }
-    layer3 = sum_vect(layer3, vec4, rows, matrices_columns[3]);
+    layer3 = sum_vect(layer3, model->biases[3], rows, matrices_columns[3]);
     layer3 = relu(layer3, rows, matrices_columns[3]);
-    free_matrix(layer2, rows);
+    free_matrix(layer2);
     layer2 = NULL;
 
-    // Compute predictions using argmax
-    local_preds = argmax(layer3, rows, matrices_columns[3]);
-    if (!local_preds) {
-        free_matrix(layer3, rows);
+    // Compute predictions (argmax) and the top-k ranking
+    for (int i = 0; i < rows; i++) {
+        int ranking = rank_outputs(layer3[i], matrices_columns[3]);
+        td->predictions[td->start + i] = ranking & 0xF;
+        if (td->rankings) td->rankings[td->start + i] = ranking;
+    }
+    free_matrix(layer3);
+
+    return 0;
+}
+
+// 64-bit hash of an image row (multiply/rotate per 8-byte word, fmix64 finalizer).
+uint64_t hash_row(const double *row, int ncols) {
+    uint64_t h = 0x27D4EB2F165667C5ULL ^ (uint64_t)ncols;
+    for (int i = 0; i < ncols; i++) {
+        uint64_t w;
+        memcpy(&w, &row[i], sizeof(w));
+        h ^= w * 0x9E3779B97F4A7C15ULL;
+        h = ((h << 31) | (h >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Allocate the cache with room for about `capacity` predictions.
+void prediction_cache_init(int capacity) {
+    if (data_ncols > CACHE_KEY_WORDS * 8) {
+        fprintf(stderr, "Error: The prediction cache holds rows of at most %d pixels\n", CACHE_KEY_WORDS * 8);
+        exit(1);
+    }
+    int buckets = capacity / (CACHE_SHARDS * CACHE_WAYS);
+    if (buckets < 1) buckets = 1;
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        CacheShard *shard = &cache_shards[s];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->entries = calloc((size_t)buckets * CACHE_WAYS, sizeof(CacheEntry));
+        shard->keys = calloc((size_t)buckets * CACHE_WAYS * CACHE_KEY_WORDS, sizeof(uint64_t));
+        if (!shard->entries || !shard->keys) {
+            fprintf(stderr, "Error: Could not allocate memory for the prediction cache\n");
+            exit(1);
+        }
+        shard->buckets = buckets;
+        shard->clock = 0;
+        shard->evictions = 0;
+    }
+}
+
+// Drop every cached prediction (needed whenever the model changes).
+void prediction_cache_clear(void) {
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        CacheShard *shard = &cache_shards[s];
+        if (!shard->entries) continue;
+        pthread_mutex_lock(&shard->lock);
+        for (int e = 0; e < shard->buckets * CACHE_WAYS; e++) {
+            CacheEntry *entry = &shard->entries[e];
+            uint_fast64_t v = atomic_load_explicit(&entry->version, memory_order_relaxed);
+            atomic_store_explicit(&entry->version, v + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            atomic_store_explicit(&entry->filled, 0, memory_order_relaxed);
+            atomic_store_explicit(&entry->version, v + 2, memory_order_release);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void prediction_cache_free(void) {
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        if (!cache_shards[s].entries) continue;
+        pthread_mutex_destroy(&cache_shards[s].lock);
+        free(cache_shards[s].entries);
+        free(cache_shards[s].keys);
+        cache_shards[s].entries = NULL;
+        cache_shards[s].keys = NULL;
+    }
+}
+
+// Index of the first way of the bucket of `hash` in its shard
+static size_t cache_bucket(const CacheShard *shard, uint64_t hash) {
+    return (hash % shard->buckets) * CACHE_WAYS;
+}
+
+// Pack a row into one byte per pixel. Returns 0 (the row is not cached) if
+// a value is not an integer in [0, 255].
+static int cache_pack_row(const double *row, uint64_t *key) {
+    memset(key, 0, CACHE_KEY_WORDS * sizeof(uint64_t));
+    for (int i = 0; i < data_ncols; i++) {
+        double v = row[i];
+        if (!(v >= 0 && v <= 255) || v != (int)v) return 0;
+        key[i / 8] |= (uint64_t)(int)v << (i % 8 * 8);
+    }
+    return 1;
+}
+
+// Word-by-word compare against a stored key. Readers run it inside the
+// seqlock window, so a torn read only fails the version check.
+static int cache_key_equal(_Atomic uint64_t *stored, const uint64_t *key) {
+    for (int w = 0; w < CACHE_KEY_WORDS; w++) {
+        if (atomic_load_explicit(&stored[w], memory_order_relaxed) != key[w]) return 0;
+    }
+    return 1;
+}
+
+// Lock-free lookup. Returns 1 and sets *ranking on an exact match computed
+// by model generation `generation`, 0 on a miss and -1 if the row cannot be
+// cached at all.
+int prediction_cache_lookup(uint64_t hash, const double *row, int generation, int *ranking) {
+    uint64_t key[CACHE_KEY_WORDS];
+    if (!cache_pack_row(row, key)) return -1;
+    CacheShard *shard = &cache_shards[hash >> 58];  // top 6 bits pick the shard
+    size_t first = cache_bucket(shard, hash);
+    for (int w = 0; w < CACHE_WAYS; w++) {
+        CacheEntry *entry = &shard->entries[first + w];
+        uint_fast64_t v1 = atomic_load_explicit(&entry->version, memory_order_acquire);
+        if (v1 & 1) continue;  // being rewritten, treat as a miss
+        uint64_t h = atomic_load_explicit(&entry->hash, memory_order_relaxed);
+        int filled = atomic_load_explicit(&entry->filled, memory_order_relaxed);
+        int cached_ranking = atomic_load_explicit(&entry->ranking, memory_order_relaxed);
+        int cached_generation = atomic_load_explicit(&entry->generation, memory_order_relaxed);
+        int same = filled && h == hash && cached_generation == generation &&
+                   cache_key_equal(&shard->keys[(first + w) * CACHE_KEY_WORDS], key);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&entry->version, memory_order_relaxed) != v1) continue;
+        if (!same) continue;
+        *ranking = cached_ranking;
         return 1;
     }
-    for (int i = 0; i < rows; i++) {
-        td->predictions[td->start + i] = local_preds[i];
+    return 0;
+}
+
+// Insert a ranking; an entry of the same row from another model generation
+// is overwritten, otherwise a full bucket evicts its ways round-robin.
+void prediction_cache_insert(uint64_t hash, const double *row, int generation, int ranking) {
+    uint64_t key[CACHE_KEY_WORDS];
+    if (!cache_pack_row(row, key)) return;
+    CacheShard *shard = &cache_shards[hash >> 58];
+    size_t first = cache_bucket(shard, hash);
+    pthread_mutex_lock(&shard->lock);
+
+    int victim = -1;
+    for (int w = 0; w < CACHE_WAYS; w++) {
+        CacheEntry *entry = &shard->entries[first + w];
+        int filled = atomic_load_explicit(&entry->filled, memory_order_relaxed);
+        if (filled && atomic_load_explicit(&entry->hash, memory_order_relaxed) == hash &&
+            cache_key_equal(&shard->keys[(first + w) * CACHE_KEY_WORDS], key)) {
+            if (atomic_load_explicit(&entry->generation, memory_order_relaxed) == generation) {
+                pthread_mutex_unlock(&shard->lock);  // already cached by another thread
+                return;
+            }
+            victim = w;  // stale: computed by an older model
+            break;
+        }
+        if (!filled && victim < 0) victim = w;
+    }
+    if (victim < 0) {
+        victim = shard->clock++ % CACHE_WAYS;
+        shard->evictions++;
     }
-    free(local_preds);
-    free_matrix(layer3, rows);
 
+    CacheEntry *entry = &shard->entries[first + victim];
+    _Atomic uint64_t *stored = &shard->keys[(first + victim) * CACHE_KEY_WORDS];
+    uint_fast64_t v = atomic_load_explicit(&entry->version, memory_order_relaxed);
+    atomic_store_explicit(&entry->version, v + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&entry->hash, hash, memory_order_relaxed);
+    for (int w = 0; w < CACHE_KEY_WORDS; w++) {
+        atomic_store_explicit(&stored[w], key[w], memory_order_relaxed);
+    }
+    atomic_store_explicit(&entry->filled, 1, memory_order_relaxed);
+    atomic_store_explicit(&entry->ranking, ranking, memory_order_relaxed);
+    atomic_store_explicit(&entry->generation, generation, memory_order_relaxed);
+    atomic_store_explicit(&entry->version, v + 2, memory_order_release);
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Total evictions since the cache was created.
+static long prediction_cache_evictions(void) {
+    long total = 0;
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        if (!cache_shards[s].entries) continue;
+        pthread_mutex_lock(&cache_shards[s].lock);
+        total += cache_shards[s].evictions;
+        pthread_mutex_unlock(&cache_shards[s].lock);
+    }
+    return total;
+}
+
+// Serve the rows of td from the prediction cache and run only the misses
+// through thread_forward(). Rows go in micro-batches of micro_batch_rows so
+// that repeats inside one thread's block already hit the predictions of
+// earlier batches. Every finished batch is added to the thread's evaluation
+// tally and published to the viewer. Each batch pins the model that is live
+// when it starts, so a hot swap takes effect at the next batch.
+int cached_thread_forward(ThreadData *td) {
+    uint64_t hashes[MICRO_BATCH_MAX];
+    double *pending[MICRO_BATCH_MAX];
+    int pending_idx[MICRO_BATCH_MAX];
+    int pending_preds[MICRO_BATCH_MAX];
+    int pending_rankings[MICRO_BATCH_MAX];
+    int rankings[MICRO_BATCH_MAX];
+    char cacheable[MICRO_BATCH_MAX];
+    int batch = (micro_batch_rows > 0 && micro_batch_rows <= MICRO_BATCH_MAX) ? micro_batch_rows : MICRO_BATCH_MAX;
+
+    for (int chunk = td->start; chunk < td->end; chunk += batch) {
+        int chunk_rows = (td->end - chunk < batch) ? td->end - chunk : batch;
+        LiveModel *live = model_acquire();
+        int misses = 0;
+        int uncacheable = 0;
+        for (int i = 0; i < chunk_rows; i++) {
+            double *row = td->input_data[chunk + i];
+            cacheable[i] = 0;
+            if (cache_enabled) {
+                hashes[i] = hash_row(row, data_ncols);
+                int found = prediction_cache_lookup(hashes[i], row, live->generation, &rankings[i]);
+                if (found > 0) continue;
+                cacheable[i] = (found == 0);
+                uncacheable += (found < 0);
+            }
+            pending[misses] = row;
+            pending_idx[misses++] = i;
+        }
+        if (cache_enabled) {
+            td->cache_hits += chunk_rows - misses;
+            td->cache_misses += misses - uncacheable;
+            td->cache_uncacheable += uncacheable;
+        }
+
+        if (misses > 0) {
+            ThreadData miss_td = *td;
+            miss_td.start = 0;
+            miss_td.end = misses;
+            miss_td.input_data = pending;
+            miss_td.predictions = pending_preds;
+            miss_td.rankings = pending_rankings;
+            miss_td.model = live->model;
+            if (thread_forward(&miss_td) != 0) {
+                model_release(live);
+                return 1;
+            }
+            for (int m = 0; m < misses; m++) {
+                int i = pending_idx[m];
+                rankings[i] = pending_rankings[m];
+                if (cacheable[i]) {
+                    prediction_cache_insert(hashes[i], pending[m], live->generation, pending_rankings[m]);
+                }
+            }
+        }
+        atomic_fetch_add_explicit(&live->rows_served, chunk_rows, memory_order_relaxed);
+        model_release(live);
+
+        for (int i = 0; i < chunk_rows; i++) {
+            td->predictions[chunk + i] = rankings[i] & 0xF;
+            if (td->labels) tally_add(&td->tally, chunk + i, rankings[i], td->labels[chunk + i]);
+        }
+        if (td->published) {
+            atomic_store_explicit(td->published, chunk + chunk_rows - td->start, memory_order_release);
+        }
+    }
     return 0;
 }
 
 // Add thread wrapper for pthreads
 void* thread_forward_wrapper(void* arg) {
-    thread_forward(arg);
+    cached_thread_forward(arg);
     return NULL;
 }
 
 // Modify parallel_forward_pass to use pthreads
 int* parallel_forward_pass(double **data) {
-    extern int thread_count;
-    printf("\n=== Starting Parallel Forward Pass with %d threads ===\n", thread_count);
+    return parallel_forward_rows(data, labels, data_nrows);
+}
+
+// Run the pass opened with prediction_feed_open() over the first rows of
+// `rows`. With row_labels the merged metrics are left in eval_result.
+static void parallel_forward_feed(double **rows, const int *row_labels) {
+    int *predictions = atomic_load_explicit(&prediction_feed.predictions, memory_order_relaxed);
+    int nrows = prediction_feed.nrows;
+    int thread_count = prediction_feed.nthreads;
+    int rows_per_thread = prediction_feed.rows_per_thread;
+    if (forward_verbose) printf("\n=== Starting Parallel Forward Pass with %d threads ===\n", thread_count);
     
-    int *predictions = malloc(data_nrows * sizeof(int));
-    int rows_per_thread = data_nrows / thread_count;
     ThreadData *td = malloc(thread_count * sizeof(ThreadData));
     pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
     TimingInfo thread_timing;
+
     start_timing(&thread_timing, "Thread Creation");
     
     for (int i = 0; i < thread_count; i++) {
         td[i].thread_id = i;
         td[i].start = i * rows_per_thread;
-        td[i].end = (i == thread_count-1) ? data_nrows : (i+1)*rows_per_thread;
-        td[i].input_data = data;
+        td[i].end = (i == thread_count-1) ? nrows : (i+1)*rows_per_thread;
+        td[i].input_data = rows;
         td[i].predictions = predictions;
+        td[i].cache_hits = 0;
+        td[i].cache_misses = 0;
+        td[i].cache_uncacheable = 0;
+        td[i].rankings = NULL;
+        td[i].labels = row_labels;
+        td[i].published = &prediction_feed.published[i];
+        td[i].model = NULL;  // each micro-batch pins the live model
+        tally_init(&td[i].tally);
         
         int ret = pthread_create(&threads[i], NULL, thread_forward_wrapper, &td[i]);
         if (ret != 0) {
             perror("pthread_create");
             exit(1);
         }
-        measure_thread_time(&thread_timing, i, "Created");
-        printf("Created thread %d handling rows %d to %d\n", 
-               i, td[i].start, td[i].end);
+        if (forward_verbose) {
+            measure_thread_time(&thread_timing, i, "Created");
+            printf("Created thread %d handling rows %d to %d\n", 
+                   i, td[i].start, td[i].end);
+        }
     }
     
+    cache_hits_total = 0;
+    cache_misses_total = 0;
+    cache_uncacheable_total = 0;
+    tally_free(&eval_result);
+    tally_init(&eval_result);
     for (int i = 0; i < thread_count; i++) {
         pthread_join(threads[i], NULL);
-        measure_thread_time(&thread_timing, i, "Completed");
+        if (forward_verbose) measure_thread_time(&thread_timing, i, "Completed");
+        cache_hits_total += td[i].cache_hits;
+        cache_misses_total += td[i].cache_misses;
+        cache_uncacheable_total += td[i].cache_uncacheable;
+        tally_merge(&eval_result, &td[i].tally);  // thread order keeps rows ascending
+        tally_free(&td[i].tally);
     }
     
     end_timing(&thread_timing);
-    printf("\nTotal thread management time: %.4f seconds\n", thread_timing.elapsed_time);
+    if (forward_verbose) printf("\nTotal thread management time: %.4f seconds\n", thread_timing.elapsed_time);
     
     free(td);
     free(threads);
     
-    printf("\n=== Parallel Forward Pass Complete ===\n");
+    if (forward_verbose) printf("\n=== Parallel Forward Pass Complete ===\n");
+}
+
+// Parallel forward pass over the first nrows rows of `rows`. With
+// row_labels the merged metrics are left in eval_result.
+int* parallel_forward_rows(double **rows, const int *row_labels, int nrows) {
+    int *predictions = malloc(nrows * sizeof(int));
+    prediction_feed_open(predictions, nrows);
+    parallel_forward_feed(rows, row_labels);
     return predictions;
 }
 
-int control_errores(const char *checkFile) {
-    FILE *f = fopen(checkFile, "r");
-    if (f == NULL) {
-        printf("errno: %d\n", errno);
+// Open the feed for a pass of thread_count workers over nrows rows. Call it
+// before starting any thread that reads the feed or runs the pass: the
+// fields are plain ints and are only safe to read after this.
+void prediction_feed_open(int *predictions, int nrows) {
+    extern int thread_count;
+    prediction_feed_free();
+    prediction_feed.nrows = nrows;
+    prediction_feed.nthreads = thread_count;
+    prediction_feed.rows_per_thread = nrows / thread_count;
+    prediction_feed.published = calloc(thread_count, sizeof(atomic_int));
+    atomic_store_explicit(&prediction_feed.predictions, predictions, memory_order_release);
+}
+
+// Rows of the open pass, 0 if no pass was opened.
+int prediction_feed_rows(void) {
+    if (!atomic_load_explicit(&prediction_feed.predictions, memory_order_acquire)) return 0;
+    return prediction_feed.nrows;
+}
+
+// Prediction of `row` if its worker has published it, otherwise -1.
+int prediction_feed_get(int row) {
+    int *predictions = atomic_load_explicit(&prediction_feed.predictions, memory_order_acquire);
+    if (!predictions || row < 0 || row >= prediction_feed.nrows) return -1;
+    int t = prediction_feed.rows_per_thread ? row / prediction_feed.rows_per_thread : prediction_feed.nthreads - 1;
+    if (t >= prediction_feed.nthreads) t = prediction_feed.nthreads - 1;
+    int done = atomic_load_explicit(&prediction_feed.published[t], memory_order_acquire);
+    return (row - t * prediction_feed.rows_per_thread < done) ? predictions[row] : -1;
+}
+
+// Rows published so far by the current (or last) forward pass.
+long prediction_feed_done(void) {
+    if (!atomic_load_explicit(&prediction_feed.predictions, memory_order_acquire)) return 0;
+    long done = 0;
+    for (int t = 0; t < prediction_feed.nthreads; t++) {
+        done += atomic_load_explicit(&prediction_feed.published[t], memory_order_acquire);
+    }
+    return done;
+}
+
+// Close the feed. The predictions array itself belongs to the caller.
+void prediction_feed_free(void) {
+    atomic_store_explicit(&prediction_feed.predictions, NULL, memory_order_release);
+    free(prediction_feed.published);
+    prediction_feed.published = NULL;
+    prediction_feed.nrows = 0;
+}
+
+// Allocate the job's predictions and open the feed for them. Runs on the
+// main thread before the coordinator starts, so the viewer sees the pass
+// as live from its first frame.
+void inference_job_open(InferenceJob *job) {
+    job->predictions = malloc(data_nrows * sizeof(int));
+    prediction_feed_open(job->predictions, data_nrows);
+}
+
+// Coordinator thread: runs and times the forward pass opened by
+// inference_job_open() so that the viewer's lifetime never shows up in (or
+// holds back) the inference numbers.
+void *inference_coordinator(void *arg) {
+    InferenceJob *job = arg;
+    int dtlb_fd = dtlb_counter_open();  // opened here so the viewer's misses don't count
+    start_timing(job->timing, "Forward Pass");
+    parallel_forward_feed(job->data, labels);
+    end_timing(job->timing);
+    job->dtlb_misses = dtlb_counter_read(dtlb_fd);
+    job->huge_kb = anon_huge_kb();
+    atomic_store(&job->finished, 1);
+    return NULL;
+}
+
+// Pin the live model: announce the read in this thread's slot, load the
+// pointer, take a reference, leave. Release it with model_release().
+LiveModel *model_acquire(void) {
+    if (reader_slot < 0) {
+        reader_slot = atomic_fetch_add(&next_reader_slot, 1) % MODEL_READER_SLOTS;
+    }
+    ReaderSlot *slot = &model_readers[reader_slot];
+    atomic_fetch_add(&slot->active, 1);
+    LiveModel *live = atomic_load(&live_model);
+    atomic_fetch_add_explicit(&live->refs, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&slot->active, 1, memory_order_release);
+    return live;
+}
+
+// Drop a reference; the last one frees a reloaded model.
+void model_release(LiveModel *live) {
+    if (atomic_fetch_sub_explicit(&live->refs, 1, memory_order_acq_rel) != 1) return;
+    printf("Model generation %d (seed %d) retired after serving %ld rows\n", live->generation,
+           live->model->seed, atomic_load(&live->rows_served));
+    if (live->owned) {
+        unload_model(live->model);
+        free(live->model);
+        free(live);
+    }
+}
+
+// Publish a freshly loaded model (ownership passes to the LiveModel) and
+// return its generation. Batches already running keep the old model; it is
+// released after a grace period in which every reader slot has drained,
+// so no reader can still be between loading the old pointer and taking its
+// reference.
+int model_swap(Model *model) {
+    LiveModel *next = calloc(1, sizeof(LiveModel));
+    if (!next) {
+        fprintf(stderr, "Error: Could not allocate memory for the model swap\n");
+        exit(1);
+    }
+    next->model = model;
+    next->owned = 1;
+    next->generation = atomic_fetch_add(&model_generations, 1) + 1;
+    atomic_store(&next->refs, 1);
+
+    pthread_mutex_lock(&model_swap_lock);
+    LiveModel *old = atomic_exchange(&live_model, next);
+    for (int i = 0; i < MODEL_READER_SLOTS; i++) {
+        while (atomic_load(&model_readers[i].active) != 0) {
+            cpu_relax();
+        }
+    }
+    pthread_mutex_unlock(&model_swap_lock);
+    model_release(old);  // the publication's reference
+    return next->generation;
+}
+
+// Load the parameter files of `seed` and swap them in. The current model
+// stays live if the files cannot be read.
+int model_reload(char *path, int seed) {
+    Model *model = calloc(1, sizeof(Model));
+    if (!model) {
+        fprintf(stderr, "Error: Could not allocate memory for the model reload\n");
+        return -1;
+    }
+    if (load_model(model, path, seed) != 0) {
+        fprintf(stderr, "Error: Could not load the parameters of seed %d, keeping the current model\n", seed);
+        unload_model(model);
+        free(model);
+        return -1;
+    }
+    return model_swap(model);
+}
+
+// SIGHUP handler thread: every SIGHUP reloads the parameters of reload_seed.
+static void *reload_watcher(void *arg) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    for (;;) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (atomic_load(&reload_stop)) return NULL;
+        int reseed = (reload_seed >= 0) ? reload_seed : seed;
+        printf("\nSIGHUP: reloading the parameters of seed %d\n", reseed);
+        int generation = model_reload(arg, reseed);
+        if (generation > 0) printf("Model generation %d is live\n", generation);
+    }
+}
+
+// Block SIGHUP in this thread (and every thread it creates from now on) and
+// leave it to the watcher. Call before starting any worker threads.
+void reload_watcher_start(char *path) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    atomic_store(&reload_stop, 0);
+    if (pthread_create(&reload_thread, NULL, reload_watcher, path) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    reload_running = 1;
+}
+
+void reload_watcher_stop(void) {
+    if (!reload_running) return;
+    atomic_store(&reload_stop, 1);
+    pthread_kill(reload_thread, SIGHUP);
+    pthread_join(reload_thread, NULL);
+    reload_running = 0;
+}
+
+int control_errores(const char *checkFile) {
+    FILE *f = fopen(checkFile, "r");
+    if (f == NULL) {
+        printf("errno: %d\n", errno);
         printf("Error: %s\n", strerror(errno));
         perror("Houston, we have a problem");
         return 1;
@@ -759,55 +2525,142 @@ int control_errores(const char *checkFile) {
     return 0;
 }
 
-double final_result(int *predictions, double *actual_digits, int num_samples) {
-    int correct_predictions = 0;
-    
-    for (int i = 0; i < num_samples; i++) {
-        if (predictions[i] == (int)actual_digits[i]) {
-            correct_predictions++;
+// Pack the indices of the TOPK_MAX largest outputs, best first, 4 bits each.
+// Ties keep the lower index, like argmax().
+int rank_outputs(const double *outputs, int n) {
+    int ranking = 0, chosen = 0;
+    for (int k = 0; k < TOPK_MAX && k < n; k++) {
+        int best = -1;
+        for (int j = 0; j < n; j++) {
+            if (chosen & (1 << j)) continue;
+            if (best < 0 || outputs[j] > outputs[best]) best = j;
         }
+        chosen |= 1 << best;
+        ranking |= best << (4 * k);
     }
-    
-    return (correct_predictions / (double)num_samples) * 100.0;
+    return ranking;
 }
 
-double error_log(int *predictions, double *actual_digits, int num_samples, int max_errors_to_log) {
-    int total_errors = 0;
-    int logged_errors = 0;
-    
+void tally_init(EvalTally *tally) {
+    memset(tally, 0, sizeof(*tally));
+    tally->logged = malloc(MAX_LOGGED_ERRORS * sizeof(ErrorEntry));
+}
+
+// Count one row. Labels outside 0..9 (missing digits) count as errors.
+void tally_add(EvalTally *tally, int row, int ranking, int label) {
+    int predicted = ranking & 0xF;
+    tally->samples++;
+    if (label >= 0 && label < NUM_CLASSES) {
+        tally->confusion[label][predicted]++;
+        for (int k = 0; k < TOPK_MAX; k++) {
+            if (((ranking >> (4 * k)) & 0xF) == label) {
+                for (int j = k; j < TOPK_MAX; j++) tally->topk_hits[j]++;
+                break;
+            }
+        }
+    }
+    if (predicted != label) {
+        tally->errors++;
+        if (tally->logged && tally->nlogged < MAX_LOGGED_ERRORS) {
+            tally->logged[tally->nlogged].row = row;
+            tally->logged[tally->nlogged].predicted = predicted;
+            tally->logged[tally->nlogged].actual = label;
+            tally->nlogged++;
+        }
+    }
+}
+
+// Add src into dst. Merging in row order keeps the first logged errors.
+void tally_merge(EvalTally *dst, const EvalTally *src) {
+    for (int a = 0; a < NUM_CLASSES; a++) {
+        for (int p = 0; p < NUM_CLASSES; p++) {
+            dst->confusion[a][p] += src->confusion[a][p];
+        }
+    }
+    for (int k = 0; k < TOPK_MAX; k++) {
+        dst->topk_hits[k] += src->topk_hits[k];
+    }
+    dst->samples += src->samples;
+    dst->errors += src->errors;
+    for (int i = 0; i < src->nlogged && dst->logged && dst->nlogged < MAX_LOGGED_ERRORS; i++) {
+        dst->logged[dst->nlogged++] = src->logged[i];
+    }
+}
+
+void tally_free(EvalTally *tally) {
+    free(tally->logged);
+    tally->logged = NULL;
+    tally->nlogged = 0;
+}
+
+double final_result(const EvalTally *tally) {
+    if (tally->samples == 0) return 0.0;
+    return ((tally->samples - tally->errors) / (double)tally->samples) * 100.0;
+}
+
+double error_log(const EvalTally *tally, int max_errors_to_log) {
     printf("\n=== Error Log: Model Prediction Failures ===\n");
     printf("Format: [Line Number] Predicted: X, Actual: Y\n");
     printf("----------------------------------------\n");
     
-    // Count errors and log details for misclassified samples
-    for (int i = 0; i < num_samples; i++) {
-        if (predictions[i] != (int)actual_digits[i]) {
-            total_errors++;
-            
-            // Log error details (up to max_errors_to_log)
-            if (logged_errors < max_errors_to_log) {
-                printf("[Line %5d] Predicted: %d, Actual: %.0f\n", 
-                       i + 1,  // Line number (1-indexed for user readability)
-                       predictions[i],  // Model's prediction
-                       actual_digits[i]);  // Actual digit
-                logged_errors++;
-            }
-        }
+    // Misclassified rows were collected by the workers, in row order
+    int logged_errors = 0;
+    for (int i = 0; i < tally->nlogged && logged_errors < max_errors_to_log; i++) {
+        printf("[Line %5d] Predicted: %d, Actual: %d\n", 
+               tally->row_base + tally->logged[i].row + 1,  // Line number (1-indexed for user readability)
+               tally->logged[i].predicted,  // Model's prediction
+               tally->logged[i].actual);  // Actual digit
+        logged_errors++;
     }
     
     // If there are more errors than we logged, indicate that
-    if (total_errors > logged_errors) {
-        printf("... and %d more errors not shown\n", total_errors - logged_errors);
+    if (tally->errors > logged_errors) {
+        printf("... and %ld more errors not shown\n", tally->errors - logged_errors);
     }
     
     // Calculate and return error rate
-    double error_rate = (total_errors / (double)num_samples) * 100.0;
-    printf("\nSummary: %d errors out of %d samples (%.2f%% error rate)\n", 
-           total_errors, num_samples, error_rate);
+    double error_rate = tally->samples ? (tally->errors / (double)tally->samples) * 100.0 : 0.0;
+    printf("\nSummary: %ld errors out of %ld samples (%.2f%% error rate)\n", 
+           tally->errors, tally->samples, error_rate);
     
     return error_rate;
 }
 
+// Confusion matrix, per-class precision/recall and top-k accuracy.
+void print_eval_report(const EvalTally *tally) {
+    printf("\n=== Confusion Matrix (rows: actual, columns: predicted) ===\n");
+    printf("      ");
+    for (int p = 0; p < NUM_CLASSES; p++) printf("%7d", p);
+    printf("\n");
+    for (int a = 0; a < NUM_CLASSES; a++) {
+        printf("%5d ", a);
+        for (int p = 0; p < NUM_CLASSES; p++) printf("%7ld", tally->confusion[a][p]);
+        printf("\n");
+    }
+
+    printf("\n=== Per-Class Metrics ===\n");
+    printf("┌───────┬──────────┬───────────┬──────────┬──────────┐\n");
+    printf("│ Digit │ Samples  │ Precision │  Recall  │    F1    │\n");
+    printf("├───────┼──────────┼───────────┼──────────┼──────────┤\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        long actual = 0, predicted = 0, hits = tally->confusion[c][c];
+        for (int j = 0; j < NUM_CLASSES; j++) {
+            actual += tally->confusion[c][j];
+            predicted += tally->confusion[j][c];
+        }
+        double precision = predicted ? hits * 100.0 / predicted : 0.0;
+        double recall = actual ? hits * 100.0 / actual : 0.0;
+        double f1 = (precision + recall > 0) ? 2 * precision * recall / (precision + recall) : 0.0;
+        printf("│ %5d │ %8ld │ %8.2f%% │ %7.2f%% │ %7.2f%% │\n", c, actual, precision, recall, f1);
+    }
+    printf("└───────┴──────────┴───────────┴──────────┴──────────┘\n");
+
+    for (int k = 0; k < TOPK_MAX; k++) {
+        printf("Top-%d accuracy: %.2f%%\n", k + 1,
+               tally->samples ? tally->topk_hits[k] * 100.0 / tally->samples : 0.0);
+    }
+}
+
 // Add these functions before main()
 void start_timing(TimingInfo* timing, const char* operation) {
     timing->operation = operation;
@@ -825,6 +2678,14 @@ void print_timing(TimingInfo* timing) {
     printf("│ %-36s│ %11.4f s │\n", timing->operation, timing->elapsed_time);
 }
 
+void print_counter(const char* label, long value) {
+    printf("│ %-36s│ %13ld │\n", label, value);
+}
+
+void print_info(const char* label, const char* value) {
+    printf("│ %-36s│ %13s │\n", label, value);
+}
+
 void print_timing_header() {
     printf("┌─────────────────────────────────────┬───────────────┐\n");
     printf("│ Operation                           │   Time (s)    │\n");
@@ -845,6 +2706,1358 @@ void measure_thread_time(TimingInfo* timing, int thread_id, const char* event) {
     printf("Thread %d - %s: %.4f seconds\n", thread_id, event, elapsed);
 }
 
+// Symmetric eigendecomposition (cyclic Jacobi). On return the diagonal of
+// sym holds the eigenvalues and the columns of vecs the eigenvectors.
+static void jacobi_eigen(double **sym, int n, double **vecs) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            vecs[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = 0, diag = 0;
+        for (int p = 0; p < n; p++) {
+            diag += sym[p][p] * sym[p][p];
+            for (int q = p + 1; q < n; q++) {
+                off += sym[p][q] * sym[p][q];
+            }
+        }
+        if (off <= 1e-24 * diag) break;
+
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                if (fabs(sym[p][q]) < 1e-300) continue;
+                double theta = (sym[q][q] - sym[p][p]) / (2.0 * sym[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < n; k++) {
+                    double akp = sym[k][p], akq = sym[k][q];
+                    sym[k][p] = c * akp - s * akq;
+                    sym[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++) {
+                    double apk = sym[p][k], aqk = sym[q][k];
+                    sym[p][k] = c * apk - s * aqk;
+                    sym[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++) {
+                    double vkp = vecs[k][p], vkq = vecs[k][q];
+                    vecs[k][p] = c * vkp - s * vkq;
+                    vecs[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+// Truncated SVD of weights (nrows x ncols): weights ~= A (nrows x rank) * B (rank x ncols).
+// Uses the eigenvectors V of weights^T * weights: B = V_r^T and A = weights * V_r = U_r * S_r.
+// Returns the percentage of the spectral energy kept, or -1 on error.
+int lowrank_factorize(double **weights, int nrows, int ncols, int rank, double ***a_out, double ***b_out) {
+    if (rank <= 0 || rank > ncols) {
+        fprintf(stderr, "Error: Invalid rank %d (must be 1..%d)\n", rank, ncols);
+        return -1;
+    }
+
+    // Gram matrix: weights^T * weights (ncols x ncols)
+    double **gram = alloc_matrix(ncols, ncols);
+    double **vecs = alloc_matrix(ncols, ncols);
+    if (!gram || !vecs) {
+        fprintf(stderr, "Error: Could not allocate memory for the factorization\n");
+        exit(1);
+    }
+    for (int k = 0; k < nrows; k++) {
+        for (int i = 0; i < ncols; i++) {
+            double wki = weights[k][i];
+            for (int j = i; j < ncols; j++) {
+                gram[i][j] += wki * weights[k][j];
+            }
+        }
+    }
+    for (int i = 0; i < ncols; i++) {
+        for (int j = 0; j < i; j++) {
+            gram[i][j] = gram[j][i];
+        }
+    }
+
+    jacobi_eigen(gram, ncols, vecs);
+
+    // Order the eigenpairs by decreasing eigenvalue (squared singular value)
+    int *order = malloc(ncols * sizeof(int));
+    double total = 0, kept = 0;
+    for (int i = 0; i < ncols; i++) {
+        order[i] = i;
+        total += gram[i][i];
+    }
+    for (int i = 1; i < ncols; i++) {
+        int cur = order[i], j = i - 1;
+        while (j >= 0 && gram[order[j]][order[j]] < gram[cur][cur]) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = cur;
+    }
+
+    // V_r (ncols x rank) and B = V_r^T (rank x ncols)
+    double **vr = alloc_matrix(ncols, rank);
+    double **b = alloc_matrix(rank, ncols);
+    for (int r = 0; r < rank; r++) {
+        kept += gram[order[r]][order[r]];
+        for (int i = 0; i < ncols; i++) {
+            vr[i][r] = vecs[i][order[r]];
+            b[r][i] = vecs[i][order[r]];
+        }
+    }
+    *a_out = mat_mul(weights, nrows, ncols, vr, rank);
+    *b_out = b;
+
+    free(order);
+    free_matrix(vr);
+    free_matrix(vecs);
+    free_matrix(gram);
+    return (total > 0) ? (int)(kept / total * 100.0 + 0.5) : 100;
+}
+
+// Free the low-rank factors and go back to the full mat1.
+void lowrank_unload(void) {
+    if (lowrank_rank > 0) {
+        free_matrix(mat1_a);
+        free_matrix(mat1_b);
+    }
+    mat1_a = NULL;
+    mat1_b = NULL;
+    lowrank_rank = 0;
+}
+
+// Run the forward pass on a copy of the dataset with 4 KB pages and with
+// huge pages and compare time and dTLB misses. The huge pages backing each
+// copy are measured (AnonHugePages), not assumed from the allocation path.
+void hugepage_benchmark(double **data) {
+    const char *labels[2] = {"4 KB pages", "Huge pages"};
+    MemBacking backing[2];
+    double seconds[2];
+    long long misses[2];
+    long huge_kb[2];
+    int saved_cache = cache_enabled;
+    cache_enabled = 0;  // every row must go through the network
+
+    for (int run = 0; run < 2; run++) {
+        hugepages_enabled = run;
+        long huge_before = anon_huge_kb();
+        double **copy = alloc_matrix(data_nrows, data_ncols);
+        if (!copy) {
+            fprintf(stderr, "Error: Could not allocate memory for the benchmark copy\n");
+            exit(1);
+        }
+        memcpy(copy[0], data[0], (size_t)data_nrows * data_ncols * sizeof(double));
+        BigAllocHeader *h = (BigAllocHeader *)((char *)copy[0] - sizeof(BigAllocHeader));
+        backing[run] = h->backing;
+        long huge_after = anon_huge_kb();
+        huge_kb[run] = (huge_before >= 0 && huge_after >= 0) ? huge_after - huge_before : -1;
+        if (backing[run] == BACKING_HUGETLB) huge_kb[run] = (long)(h->map_bytes / 1024);  // not in AnonHugePages
+
+        TimingInfo timing;
+        int fd = dtlb_counter_open();
+        start_timing(&timing, labels[run]);
+        int *predictions = parallel_forward_pass(copy);
+        end_timing(&timing);
+        misses[run] = dtlb_counter_read(fd);
+        seconds[run] = timing.elapsed_time;
+
+        free(predictions);
+        free_matrix(copy);
+    }
+    hugepages_enabled = 1;
+    cache_enabled = saved_cache;
+
+    printf("\n=== Huge Page Benchmark ===\n");
+    printf("┌────────────┬──────────────────────┬──────────────┬────────────┬─────────────────┐\n");
+    printf("│ Run        │ Dataset backing      │ Huge pg (KB) │  Time (s)  │   dTLB misses   │\n");
+    printf("├────────────┼──────────────────────┼──────────────┼────────────┼─────────────────┤\n");
+    for (int run = 0; run < 2; run++) {
+        char count[32], huge[32];
+        if (misses[run] >= 0) sprintf(count, "%lld", misses[run]);
+        else strcpy(count, "n/a");
+        if (huge_kb[run] >= 0) sprintf(huge, "%ld", huge_kb[run]);
+        else strcpy(huge, "n/a");
+        printf("│ %-10s │ %-20s │ %12s │ %10.4f │ %15s │\n", labels[run], backing_name(backing[run]), huge,
+               seconds[run], count);
+    }
+    printf("└────────────┴──────────────────────┴──────────────┴────────────┴─────────────────┘\n");
+    if (misses[0] > 0 && misses[1] >= 0) {
+        printf("dTLB miss reduction: %.1f%%\n", (1.0 - (double)misses[1] / misses[0]) * 100.0);
+    } else {
+        printf("dTLB miss reduction: n/a (perf events unavailable, see /proc/sys/kernel/perf_event_paranoid)\n");
+    }
+    printf("Speedup: %.2fx\n", seconds[0] / seconds[1]);
+}
+
+// Model name of the first CPU in /proc/cpuinfo; "unknown" if there is none.
+int cpu_model_name(char *name, size_t size) {
+    char line[256];
+    snprintf(name, size, "unknown");
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f) return 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            char *value = colon + 1;
+            while (*value == ' ') value++;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(name, size, "%s", value);
+            fclose(f);
+            return 1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// Find this CPU's line in <path>autotune.profile. Each line is
+// "<model name>\t<threads> <micro_batch> <tile_rows> <tile_k> <seconds>".
+int autotune_load(const char *path, AutotuneProfile *profile) {
+    char file[512], model[256], line[512];
+    snprintf(file, sizeof(file), "%s%s", path, AUTOTUNE_PROFILE);
+    cpu_model_name(model, sizeof(model));
+    FILE *f = fopen(file, "r");
+    if (!f) return 0;
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        char *tab = strrchr(line, '\t');
+        if (line[0] == '#' || !tab) continue;
+        *tab = '\0';
+        if (strcmp(line, model) != 0) continue;
+        found = sscanf(tab + 1, "%d %d %d %d %lf", &profile->threads, &profile->micro_batch,
+                       &profile->tile_rows, &profile->tile_k, &profile->seconds) == 5 &&
+                profile->threads > 0 && profile->micro_batch > 0 && profile->micro_batch <= MICRO_BATCH_MAX &&
+                profile->tile_rows > 0 && profile->tile_k > 0;
+    }
+    fclose(f);
+    return found;
+}
+
+// Store the profile for this CPU, replacing its previous line and keeping
+// the lines of other models.
+void autotune_save(const char *path, const AutotuneProfile *profile) {
+    char file[512], tmp[520], model[256], line[512];
+    snprintf(file, sizeof(file), "%s%s", path, AUTOTUNE_PROFILE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    cpu_model_name(model, sizeof(model));
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not write %s: %s\n", tmp, strerror(errno));
+        exit(1);
+    }
+    fprintf(out, "# model name\tthreads micro_batch tile_rows tile_k seconds\n");
+    FILE *in = fopen(file, "r");
+    while (in && fgets(line, sizeof(line), in)) {
+        char *tab = strrchr(line, '\t');
+        if (line[0] == '#' || !tab) continue;
+        if ((size_t)(tab - line) == strlen(model) && strncmp(line, model, tab - line) == 0) continue;
+        fputs(line, out);
+    }
+    if (in) fclose(in);
+    fprintf(out, "%s\t%d %d %d %d %.6f\n", model, profile->threads, profile->micro_batch,
+            profile->tile_rows, profile->tile_k, profile->seconds);
+    fclose(out);
+    if (rename(tmp, file) != 0) {
+        fprintf(stderr, "Error: Could not replace %s: %s\n", file, strerror(errno));
+        exit(1);
+    }
+}
+
+// Best of AUTOTUNE_REPEATS forward passes over the first `rows` rows.
+static double autotune_measure(double **data, int rows) {
+    double best = 0;
+    for (int r = 0; r < AUTOTUNE_REPEATS; r++) {
+        TimingInfo timing;
+        start_timing(&timing, "Autotune");
+        int *predictions = parallel_forward_rows(data, NULL, rows);
+        end_timing(&timing);
+        free(predictions);
+        if (r == 0 || timing.elapsed_time < best) best = timing.elapsed_time;
+    }
+    return best;
+}
+
+// Benchmark thread counts, then micro-batch sizes, then mat_mul tile shapes
+// (each step keeps the winners of the previous ones) on a sample of the
+// dataset and save the fastest settings for this CPU model.
+void autotune(double **data, const char *path, int max_threads) {
+    extern int thread_count;
+    int rows = (data_nrows < AUTOTUNE_SAMPLE_ROWS) ? data_nrows : AUTOTUNE_SAMPLE_ROWS;
+    int batches[] = {32, 64, 128, 256, 512, 1024};
+    int tile_rows[] = {4, 8, 16, 32, 64};
+    int tile_ks[] = {32, 64, 128, 256, 784};
+    int nbatches = sizeof(batches) / sizeof(batches[0]);
+    int ntile_rows = sizeof(tile_rows) / sizeof(tile_rows[0]);
+    int ntile_ks = sizeof(tile_ks) / sizeof(tile_ks[0]);
+    char model[256];
+    cpu_model_name(model, sizeof(model));
+
+    int saved_cache = cache_enabled;
+    cache_enabled = 0;  // every row must go through the network
+    forward_verbose = 0;
+    printf("\n=== Autotune on %d rows (%s, up to %d threads) ===\n", rows, model, max_threads);
+    printf("┌──────────────┬─────────┬─────────┬───────────┬────────┬────────────┐\n");
+    printf("│ Step         │ Threads │  Batch  │ Tile rows │ Tile k │  Time (s)  │\n");
+    printf("├──────────────┼─────────┼─────────┼───────────┼────────┼────────────┤\n");
+
+    AutotuneProfile best = {0, micro_batch_rows, matmul_tile_rows, matmul_tile_k, 0};
+    // Thread counts: powers of two below max_threads, then max_threads itself
+    int candidates[32], ncandidates = 0;
+    for (int t = 1; t < max_threads && ncandidates < 31; t *= 2) candidates[ncandidates++] = t;
+    candidates[ncandidates++] = max_threads;
+    for (int c = 0; c < ncandidates; c++) {
+        thread_count = candidates[c];
+        double seconds = autotune_measure(data, rows);
+        printf("│ %-12s │ %7d │ %7d │ %9d │ %6d │ %10.4f │\n", "threads", thread_count, micro_batch_rows,
+               matmul_tile_rows, matmul_tile_k, seconds);
+        if (best.threads == 0 || seconds < best.seconds) {
+            best.threads = thread_count;
+            best.seconds = seconds;
+        }
+    }
+    thread_count = best.threads;
+
+    for (int b = 0; b < nbatches; b++) {
+        micro_batch_rows = batches[b];
+        double seconds = autotune_measure(data, rows);
+        printf("│ %-12s │ %7d │ %7d │ %9d │ %6d │ %10.4f │\n", "micro-batch", thread_count, micro_batch_rows,
+               matmul_tile_rows, matmul_tile_k, seconds);
+        if (seconds < best.seconds) {
+            best.micro_batch = micro_batch_rows;
+            best.seconds = seconds;
+        }
+    }
+    micro_batch_rows = best.micro_batch;
+
+    for (int r = 0; r < ntile_rows; r++) {
+        for (int k = 0; k < ntile_ks; k++) {
+            matmul_tile_rows = tile_rows[r];
+            matmul_tile_k = tile_ks[k];
+            double seconds = autotune_measure(data, rows);
+            printf("│ %-12s │ %7d │ %7d │ %9d │ %6d │ %10.4f │\n", "tile shape", thread_count, micro_batch_rows,
+                   matmul_tile_rows, matmul_tile_k, seconds);
+            if (seconds < best.seconds) {
+                best.tile_rows = matmul_tile_rows;
+                best.tile_k = matmul_tile_k;
+                best.seconds = seconds;
+            }
+        }
+    }
+    matmul_tile_rows = best.tile_rows;
+    matmul_tile_k = best.tile_k;
+    printf("├──────────────┼─────────┼─────────┼───────────┼────────┼────────────┤\n");
+    printf("│ %-12s │ %7d │ %7d │ %9d │ %6d │ %10.4f │\n", "best", best.threads, best.micro_batch,
+           best.tile_rows, best.tile_k, best.seconds);
+    printf("└──────────────┴─────────┴─────────┴───────────┴────────┴────────────┘\n");
+    forward_verbose = 1;
+    cache_enabled = saved_cache;
+
+    autotune_save(path, &best);
+    printf("Profile saved to %s%s; later runs load it automatically\n", path, AUTOTUNE_PROFILE);
+}
+
+// Pack the model for predict_one(). Outputs are padded to whole panels
+// with zero weights; ~1.5 MB in total, read sequentially per image.
+int packed_model_init(const Model *model) {
+    size_t total = 0;
+    for (int l = 0; l < 4; l++) {
+        int panels = (matrices_columns[l] + GEMV_LANES - 1) / GEMV_LANES;
+        total += (size_t)panels * GEMV_LANES * (matrices_rows[l] + 1);
+    }
+    packed_model_free();
+    packed_model.block = big_alloc(total * sizeof(double), NULL);
+    if (!packed_model.block) return 1;
+    memset(packed_model.block, 0, total * sizeof(double));
+    double *next = packed_model.block;
+    for (int l = 0; l < 4; l++) {
+        int in = matrices_rows[l], out = matrices_columns[l];
+        int panels = (out + GEMV_LANES - 1) / GEMV_LANES;
+        packed_model.panels[l] = panels;
+        packed_model.weights[l] = next;
+        for (int j = 0; j < out; j++) {
+            double *panel = next + (size_t)(j / GEMV_LANES) * in * GEMV_LANES;
+            for (int k = 0; k < in; k++) {
+                panel[(size_t)k * GEMV_LANES + j % GEMV_LANES] = model->weights[l][k][j];
+            }
+        }
+        next += (size_t)panels * in * GEMV_LANES;
+        packed_model.biases[l] = next;
+        memcpy(next, model->biases[l], vector_rows[l] * sizeof(double));
+        next += (size_t)panels * GEMV_LANES;
+    }
+    return 0;
+}
+
+void packed_model_free(void) {
+    if (packed_model.block) big_free(packed_model.block);
+    memset(&packed_model, 0, sizeof(packed_model));
+}
+
+// y = relu(W x + b) for the output panels [first, last); y must have room
+// for whole panels. Each sum runs over the inputs in order, as in
+// mat_mul(), so predictions match the batch path bit for bit.
+static void gemv_relu(int layer, const double *x, double *y, int first, int last) {
+    int in = matrices_rows[layer];
+    const double *b = packed_model.biases[layer];
+    for (int p = first; p < last; p++) {
+        const double *w = packed_model.weights[layer] + (size_t)p * in * GEMV_LANES;
+        double acc[GEMV_LANES] = {0};
+        for (int k = 0; k < in; k++, w += GEMV_LANES) {
+            double xk = x[k];
+            for (int lane = 0; lane < GEMV_LANES; lane++) {
+                acc[lane] += xk * w[lane];
+            }
+        }
+        for (int lane = 0; lane < GEMV_LANES; lane++) {
+            double v = acc[lane] + b[p * GEMV_LANES + lane];
+            y[p * GEMV_LANES + lane] = (v < 0) ? 0 : v;
+        }
+    }
+}
+
+static void *latency_helper(void *arg) {
+    LatencyHelper *helper = arg;
+    LatencyPool *pool = helper->pool;
+    int seen = 0;
+    for (;;) {
+        int generation;
+        while ((generation = atomic_load_explicit(&pool->generation, memory_order_acquire)) == seen) {
+            if (atomic_load_explicit(&pool->stop, memory_order_relaxed)) return NULL;
+            cpu_relax();
+        }
+        seen = generation;
+        gemv_relu(0, pool->input, pool->hidden, helper->first, helper->last);
+        atomic_fetch_add_explicit(&pool->done, 1, memory_order_release);
+    }
+}
+
+// Start nhelpers spinning threads; together with the caller they split the
+// layer-0 panels (one cache line of outputs each). Every helper keeps a core
+// busy, so the count is capped at the online cores minus the caller.
+int latency_pool_start(int nhelpers) {
+    int panels = packed_model.panels[0];
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0 && nhelpers > cores - 1) nhelpers = (int)cores - 1;
+    if (nhelpers > panels - 1) nhelpers = panels - 1;
+    if (nhelpers < 0) nhelpers = 0;
+    latency_pool_stop();
+    latency_pool.hidden = aligned_alloc(64, LATENCY_MAX_WIDTH * sizeof(double));
+    latency_pool.helpers = calloc(nhelpers > 0 ? nhelpers : 1, sizeof(LatencyHelper));
+    if (!latency_pool.hidden || !latency_pool.helpers) return 1;
+    atomic_store(&latency_pool.generation, 0);
+    atomic_store(&latency_pool.stop, 0);
+    latency_pool.own_last = panels / (nhelpers + 1);
+    for (int h = 0; h < nhelpers; h++) {
+        LatencyHelper *helper = &latency_pool.helpers[h];
+        helper->pool = &latency_pool;
+        helper->first = (h + 1) * panels / (nhelpers + 1);
+        helper->last = (h + 2) * panels / (nhelpers + 1);
+        if (pthread_create(&helper->thread, NULL, latency_helper, helper) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        latency_pool.nhelpers = h + 1;
+    }
+    return 0;
+}
+
+void latency_pool_stop(void) {
+    atomic_store(&latency_pool.stop, 1);
+    for (int h = 0; h < latency_pool.nhelpers; h++) {
+        pthread_join(latency_pool.helpers[h].thread, NULL);
+    }
+    free(latency_pool.helpers);
+    free(latency_pool.hidden);
+    latency_pool.helpers = NULL;
+    latency_pool.hidden = NULL;
+    latency_pool.nhelpers = 0;
+}
+
+// Classify one image with the packed model. No allocation; with a helper
+// pool layer 0 is split across the helpers and the caller.
+int predict_one(const double *input) {
+    double hidden[LATENCY_MAX_WIDTH] __attribute__((aligned(64)));
+    double a[LATENCY_MAX_WIDTH], b[LATENCY_MAX_WIDTH];
+    double *h0 = hidden;
+
+    if (latency_pool.nhelpers > 0) {
+        LatencyPool *pool = &latency_pool;
+        h0 = pool->hidden;
+        atomic_store_explicit(&pool->done, 0, memory_order_relaxed);
+        pool->input = input;
+        atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+        gemv_relu(0, input, h0, 0, pool->own_last);
+        while (atomic_load_explicit(&pool->done, memory_order_acquire) < pool->nhelpers) {
+            cpu_relax();
+        }
+    } else {
+        gemv_relu(0, input, h0, 0, packed_model.panels[0]);
+    }
+    gemv_relu(1, h0, a, 0, packed_model.panels[1]);
+    gemv_relu(2, a, b, 0, packed_model.panels[2]);
+    gemv_relu(3, b, a, 0, packed_model.panels[3]);
+    return rank_outputs(a, matrices_columns[3]) & 0xF;
+}
+
+static double elapsed_us(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// One single-image request through path 0 (thread_forward on one row) or
+// path 1 (predict_one).
+static int latency_request(int path, double **row) {
+    if (path == 1) return predict_one(row[0]);
+    int predicted;
+    ThreadData td = {0};
+    td.end = 1;
+    td.input_data = row;
+    td.predictions = &predicted;
+    thread_forward(&td);
+    return predicted;
+}
+
+// Time `samples` single-image requests through the batch entry point
+// (thread_forward on one row) and through predict_one(), and report the
+// latency percentiles in microseconds.
+void latency_benchmark(double **data, int samples) {
+    extern int thread_count;
+    const char *names[2] = {"thread_forward (1 row)", "predict_one"};
+    double *latency = malloc(samples * sizeof(double));
+    double stats[2][4];  // mean, p50, p99, max
+    long correct[2] = {0, 0};
+    int mismatches = 0;
+
+    if (packed_model_init(&base_model) != 0) {
+        fprintf(stderr, "Error: Could not pack the model\n");
+        exit(1);
+    }
+
+    int *batch_preds = malloc(samples * sizeof(int));
+    for (int path = 0; path < 2; path++) {
+        // The helpers spin, so they only run while predict_one() is measured
+        if (path == 1) {
+            if (latency_pool_start(thread_count - 1) != 0) {
+                fprintf(stderr, "Error: Could not start the latency helpers\n");
+                exit(1);
+            }
+        }
+        // Warm caches and branch predictors of the measured path first
+        for (int i = 0; i < 100; i++) {
+            latency_request(path, &data[i % data_nrows]);
+        }
+        for (int i = 0; i < samples; i++) {
+            int row = i % data_nrows;
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            int predicted = latency_request(path, &data[row]);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            latency[i] = elapsed_us(&t0, &t1);
+            if (predicted == labels[row]) correct[path]++;
+            if (path == 0) batch_preds[i] = predicted;
+            else if (predicted != batch_preds[i]) mismatches++;
+        }
+        double sum = 0;
+        for (int i = 0; i < samples; i++) sum += latency[i];
+        qsort(latency, samples, sizeof(double), compare_doubles);
+        stats[path][0] = sum / samples;
+        stats[path][1] = latency[samples / 2];
+        stats[path][2] = latency[(int)(samples * 0.99) < samples ? (int)(samples * 0.99) : samples - 1];
+        stats[path][3] = latency[samples - 1];
+    }
+    int cores_used = latency_pool.nhelpers + 1;
+    latency_pool_stop();
+    packed_model_free();
+
+    printf("\n=== Latency Benchmark: %d requests, %d core(s) per predict_one() ===\n", samples, cores_used);
+    printf("┌────────────────────────┬──────────┬──────────┬──────────┬──────────┬──────────┐\n");
+    printf("│ Path                   │ Mean µs  │  p50 µs  │  p99 µs  │  Max µs  │ Accuracy │\n");
+    printf("├────────────────────────┼──────────┼──────────┼──────────┼──────────┼──────────┤\n");
+    for (int path = 0; path < 2; path++) {
+        printf("│ %-22s │ %8.1f │ %8.1f │ %8.1f │ %8.1f │ %7.2f%% │\n", names[path], stats[path][0],
+               stats[path][1], stats[path][2], stats[path][3], correct[path] * 100.0 / samples);
+    }
+    printf("└────────────────────────┴──────────┴──────────┴──────────┴──────────┴──────────┘\n");
+    printf("p50 speedup: %.2fx, predictions differing from the batch path: %d\n",
+           stats[0][1] / stats[1][1], mismatches);
+    free(batch_preds);
+    free(latency);
+}
+
+// Hot-swap demo: while a forward pass runs, load `new_seed` in the
+// background and swap it in after a third of the rows, then reload `seed`
+// after two thirds. The middle model is reclaimed as soon as its last
+// in-flight batch finishes. A second pass then runs on the final model.
+void hotswap_demo(double **data, char *path, int new_seed) {
+    TimingInfo timing;
+    InferenceJob job = { .data = data, .timing = &timing };
+    int targets[2] = {data_nrows / 3, 2 * data_nrows / 3};
+    int seeds[2] = {new_seed, seed};
+    int generations[2] = {-1, -1};
+    long swap_rows[2] = {0, 0};
+
+    printf("\n=== Hot-Swap Demo: seed %d -> %d -> %d during one pass ===\n", seed, new_seed, seed);
+    forward_verbose = 0;
+    inference_job_open(&job);
+    pthread_t coordinator;
+    if (pthread_create(&coordinator, NULL, inference_coordinator, &job) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    for (int k = 0; k < 2; k++) {
+        Model *model = calloc(1, sizeof(Model));
+        if (!model || load_model(model, path, seeds[k]) != 0) {
+            fprintf(stderr, "Error: Could not load the parameters of seed %d\n", seeds[k]);
+            exit(1);
+        }
+        // The workers keep going while the candidate is loaded; swap at the target
+        while (!atomic_load(&job.finished) && prediction_feed_done() < targets[k]) {
+            usleep(1000);
+        }
+        swap_rows[k] = prediction_feed_done();
+        generations[k] = model_swap(model);
+        printf("Generation %d (seed %d) live after %ld rows\n", generations[k], seeds[k], swap_rows[k]);
+    }
+    pthread_join(coordinator, NULL);
+    double first_accuracy = final_result(&eval_result);
+    long first_hits = cache_hits_total;
+    free(job.predictions);
+
+    // Second pass: only rows computed by the final generation may hit the cache
+    atomic_store(&job.finished, 0);
+    inference_job_open(&job);
+    inference_coordinator(&job);
+    double second_accuracy = final_result(&eval_result);
+    free(job.predictions);
+    forward_verbose = 1;
+
+    printf("┌──────────────────────────────┬──────────────┬──────────────┐\n");
+    printf("│ Pass                         │   Accuracy   │  Cache hits  │\n");
+    printf("├──────────────────────────────┼──────────────┼──────────────┤\n");
+    printf("│ With two swaps               │ %11.2f%% │ %12ld │\n", first_accuracy, first_hits);
+    printf("│ On generation %-2d             │ %11.2f%% │ %12ld │\n", generations[1], second_accuracy,
+           cache_hits_total);
+    printf("└──────────────────────────────┴──────────────┴──────────────┘\n");
+}
+
+// NN_SHARD_CRASH="<shard>[:<attempts>],..." makes a shard's worker kill
+// itself halfway through its rows on its first <attempts> (default 1) tries.
+// NN_SHARD_HANG takes the same list and makes the worker stop there instead.
+static int shard_should_fail(const char *variable, int shard, int attempt) {
+    const char *spec = getenv(variable);
+    while (spec && *spec) {
+        int target, attempts = 1;
+        if (sscanf(spec, "%d:%d", &target, &attempts) >= 1 && target == shard && attempt <= attempts) {
+            return 1;
+        }
+        spec = strchr(spec, ',');
+        if (spec) spec++;
+    }
+    return 0;
+}
+
+// Worker process: evaluate the slot's rows with `threads` threads, copy the
+// predictions and the tally into the shared region, then mark the slot done.
+static void shard_worker(double **data, ShardSlot *slot, int *predictions, int shard, int threads) {
+    extern int thread_count;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    thread_count = threads;
+    forward_verbose = 0;
+    cache_enabled = 0;  // inserts would copy the inherited cache pages and die with the worker
+
+    int crash = shard_should_fail("NN_SHARD_CRASH", shard, slot->attempts);
+    int hang = shard_should_fail("NN_SHARD_HANG", shard, slot->attempts);
+    int count = (crash || hang) ? slot->count / 2 : slot->count;
+    int *preds = parallel_forward_rows(data + slot->first, labels + slot->first, count);
+    if (crash) {
+        fprintf(stderr, "Shard %d: injected crash after %d rows (NN_SHARD_CRASH)\n", shard, count);
+        kill(getpid(), SIGKILL);
+    }
+    if (hang) {
+        fprintf(stderr, "Shard %d: injected hang after %d rows (NN_SHARD_HANG)\n", shard, count);
+        for (;;) pause();
+    }
+
+    memcpy(predictions + slot->first, preds, count * sizeof(int));
+    memcpy(slot->confusion, eval_result.confusion, sizeof(slot->confusion));
+    memcpy(slot->topk_hits, eval_result.topk_hits, sizeof(slot->topk_hits));
+    slot->samples = eval_result.samples;
+    slot->errors = eval_result.errors;
+    slot->nlogged = eval_result.nlogged;
+    for (int i = 0; i < eval_result.nlogged; i++) {
+        slot->logged[i] = eval_result.logged[i];
+        slot->logged[i].row += slot->first;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    slot->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    atomic_store_explicit(&slot->status, SHARD_DONE, memory_order_release);
+    fflush(stdout);
+    _exit(0);
+}
+
+static void shard_spawn(double **data, ShardSlot *slots, int *predictions, int shard, int threads) {
+    ShardSlot *slot = &slots[shard];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot->attempts++;
+    slot->started = now.tv_sec + now.tv_nsec / 1e9;
+    slot->timed_out = 0;
+    atomic_store(&slot->status, SHARD_RUNNING);
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        shard_worker(data, slot, predictions, shard, threads);
+    }
+    slot->pid = pid;
+}
+
+// Evaluate the dataset in `nshards` forked worker processes. The workers
+// share the parent's dataset and model pages (copy-on-write, never written)
+// and report into a MAP_SHARED region. A shard whose process dies is
+// re-forked, up to SHARD_MAX_ATTEMPTS times, without redoing the others.
+// So is a shard that is still running after the per-attempt deadline: it
+// is SIGKILLed first, since a hung worker would otherwise never be reaped.
+void shard_evaluate(double **data, int nshards) {
+    extern int thread_count;
+    int threads = (thread_count / nshards > 0) ? thread_count / nshards : 1;
+    const char *timeout_env = getenv("NN_SHARD_TIMEOUT");
+    double timeout = (timeout_env && atof(timeout_env) > 0) ? atof(timeout_env) : SHARD_TIMEOUT_SEC;
+    size_t bytes = nshards * sizeof(ShardSlot) + (size_t)data_nrows * sizeof(int);
+    void *region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map the shard result region: %s\n", strerror(errno));
+        exit(1);
+    }
+    ShardSlot *slots = region;
+    int *predictions = (int *)(slots + nshards);
+
+    printf("\n=== Sharded Evaluation: %d worker processes, %d thread(s) each, %.0f s deadline per attempt ===\n",
+           nshards, threads, timeout);
+    TimingInfo timing;
+    start_timing(&timing, "Sharded Evaluation");
+    int rows_per_shard = data_nrows / nshards;
+    for (int s = 0; s < nshards; s++) {
+        slots[s].first = s * rows_per_shard;
+        slots[s].count = (s == nshards - 1) ? data_nrows - slots[s].first : rows_per_shard;
+        shard_spawn(data, slots, predictions, s, threads);
+    }
+
+    int remaining = nshards;
+    while (remaining > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("waitpid");
+            exit(1);
+        }
+        if (pid == 0) {
+            // Nothing exited: kill the shards past their deadline, reap them next round
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double t = now.tv_sec + now.tv_nsec / 1e9;
+            for (int s = 0; s < nshards; s++) {
+                if (slots[s].pid > 0 && !slots[s].timed_out && t - slots[s].started > timeout) {
+                    slots[s].timed_out = 1;
+                    kill(slots[s].pid, SIGKILL);
+                }
+            }
+            usleep(10000);
+            continue;
+        }
+        int s = 0;
+        while (s < nshards && slots[s].pid != pid) s++;
+        if (s == nshards) continue;
+        slots[s].pid = 0;
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            atomic_load_explicit(&slots[s].status, memory_order_acquire) == SHARD_DONE) {
+            remaining--;
+            continue;
+        }
+        char reason[64];
+        if (slots[s].timed_out) snprintf(reason, sizeof(reason), "timed out after %.0f s", timeout);
+        else if (WIFSIGNALED(status)) snprintf(reason, sizeof(reason), "killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+        else snprintf(reason, sizeof(reason), "exit status %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        if (slots[s].attempts >= SHARD_MAX_ATTEMPTS) {
+            fprintf(stderr, "Error: Shard %d failed %d times (%s), giving up\n", s, slots[s].attempts, reason);
+            for (int other = 0; other < nshards; other++) {
+                if (slots[other].pid > 0) kill(slots[other].pid, SIGKILL);
+            }
+            exit(1);
+        }
+        printf("Shard %d (rows %d to %d) %s, retrying (attempt %d of %d)\n", s, slots[s].first,
+               slots[s].first + slots[s].count - 1, reason, slots[s].attempts + 1, SHARD_MAX_ATTEMPTS);
+        shard_spawn(data, slots, predictions, s, threads);
+    }
+    end_timing(&timing);
+
+    // Merge the shard tallies in row order
+    tally_free(&eval_result);
+    tally_init(&eval_result);
+    printf("┌───────┬─────────────────┬──────────┬───────────┬────────────┐\n");
+    printf("│ Shard │ Rows            │ Attempts │ Accuracy  │  Time (s)  │\n");
+    printf("├───────┼─────────────────┼──────────┼───────────┼────────────┤\n");
+    for (int s = 0; s < nshards; s++) {
+        EvalTally shard_tally = {0};
+        memcpy(shard_tally.confusion, slots[s].confusion, sizeof(shard_tally.confusion));
+        memcpy(shard_tally.topk_hits, slots[s].topk_hits, sizeof(shard_tally.topk_hits));
+        shard_tally.samples = slots[s].samples;
+        shard_tally.errors = slots[s].errors;
+        shard_tally.logged = slots[s].logged;
+        shard_tally.nlogged = slots[s].nlogged;
+        tally_merge(&eval_result, &shard_tally);
+
+        char range[32];
+        snprintf(range, sizeof(range), "%d-%d", slots[s].first, slots[s].first + slots[s].count - 1);
+        printf("│ %5d │ %-15s │ %8d │ %8.2f%% │ %10.4f │\n", s, range, slots[s].attempts,
+               final_result(&shard_tally), slots[s].seconds);
+    }
+    printf("└───────┴─────────────────┴──────────┴───────────┴────────────┘\n");
+
+    printf("\nComparing first 10 predictions with actual digits:\n");
+    for (int i = 0; i < 10 && i < data_nrows; i++) {
+        printf("Sample %d: Predicted %d, Actual %d\n", i, predictions[i], labels[i]);
+    }
+    printf("\nFinal Prediction Accuracy: %.2f%%\n", final_result(&eval_result));
+    print_eval_report(&eval_result);
+    printf("Sharded evaluation took %.4f seconds\n", timing.elapsed_time);
+    munmap(region, bytes);
+}
+
+// Sweep the layer-0 rank and report throughput against accuracy.
+void lowrank_sweep(double **data) {
+    int ranks[] = {10, 20, 30, 40, 50, 75, 100, 150};
+    int nranks = sizeof(ranks) / sizeof(ranks[0]);
+    int macs_tail = matrices_rows[1] * matrices_columns[1] + matrices_rows[2] * matrices_columns[2] +
+                    matrices_rows[3] * matrices_columns[3];
+    TimingInfo timing;
+    int saved_cache = cache_enabled;
+    cache_enabled = 0;  // time the layer-0 GEMMs, not hash lookups
+
+    // Baseline with the full 784x200 matrix
+    lowrank_unload();
+    start_timing(&timing, "Full rank");
+    int *predictions = parallel_forward_pass(data);
+    end_timing(&timing);
+    double base_time = timing.elapsed_time;
+    double base_acc = final_result(&eval_result);
+    free(predictions);
+
+    double results[sizeof(ranks) / sizeof(ranks[0])][4];  // energy, time, accuracy, macs
+    for (int i = 0; i < nranks; i++) {
+        double **a, **b;
+        int energy = lowrank_factorize(mat1, matrices_rows[0], matrices_columns[0], ranks[i], &a, &b);
+        if (energy < 0) exit(1);
+        mat1_a = a;
+        mat1_b = b;
+        lowrank_rank = ranks[i];
+
+        start_timing(&timing, "Low rank");
+        predictions = parallel_forward_pass(data);
+        end_timing(&timing);
+        results[i][0] = energy;
+        results[i][1] = timing.elapsed_time;
+        results[i][2] = final_result(&eval_result);
+        results[i][3] = (matrices_rows[0] + matrices_columns[0]) * ranks[i] + macs_tail;
+        free(predictions);
+        lowrank_unload();
+    }
+    cache_enabled = saved_cache;
+
+    printf("\n=== Low-Rank Layer 0 Sweep ===\n");
+    printf("┌────────┬────────┬──────────┬────────────┬─────────┬──────────┬──────────┐\n");
+    printf("│  Rank  │ Energy │ MACs/img │  Time (s)  │ Speedup │ Accuracy │  Delta   │\n");
+    printf("├────────┼────────┼──────────┼────────────┼─────────┼──────────┼──────────┤\n");
+    printf("│  full  │  100%%  │ %8d │ %10.4f │  1.00x  │ %7.2f%% │          │\n",
+           matrices_rows[0] * matrices_columns[0] + macs_tail, base_time, base_acc);
+    for (int i = 0; i < nranks; i++) {
+        printf("│ %6d │  %3.0f%%  │ %8.0f │ %10.4f │ %5.2fx  │ %7.2f%% │ %+7.2f%% │\n",
+               ranks[i], results[i][0], results[i][3], results[i][1],
+               base_time / results[i][1], results[i][2], results[i][2] - base_acc);
+    }
+    printf("└────────┴────────┴──────────┴────────────┴─────────┴──────────┴──────────┘\n");
+}
+
+// Run rows through all four layers of a model. Returns the (rows x 10) output.
+double** model_forward(Model *model, double **input, int rows) {
+    double **layer = input;
+    for (int l = 0; l < 4; l++) {
+        double **next = mat_mul(layer, rows, matrices_rows[l], model->weights[l], matrices_columns[l]);
+        next = sum_vect(next, model->biases[l], rows, matrices_columns[l]);
+        next = relu(next, rows, matrices_columns[l]);
+        if (layer != input) free_matrix(layer);
+        layer = next;
+    }
+    return layer;
+}
+
+// Rows per ensemble tile: 32 rows of 784 doubles (~200 KB) stay in L2 while
+// every model's layer-0 product reads them.
+#define ENSEMBLE_TILE_ROWS 32
+
+void* ensemble_thread(void *arg) {
+    EnsembleThreadData *et = (EnsembleThreadData *)arg;
+    int outputs = matrices_columns[3];
+    double **sum = alloc_matrix(ENSEMBLE_TILE_ROWS, outputs);
+
+    for (int tile = et->start; tile < et->end; tile += ENSEMBLE_TILE_ROWS) {
+        int rows = (et->end - tile < ENSEMBLE_TILE_ROWS) ? et->end - tile : ENSEMBLE_TILE_ROWS;
+        for (int i = 0; i < rows; i++) {
+            memset(sum[i], 0, outputs * sizeof(double));
+        }
+
+        // Same input tile through every model while it is still cached
+        for (int k = 0; k < et->nmodels; k++) {
+            double **out = model_forward(&et->models[k], et->input_data + tile, rows);
+            int *preds = argmax(out, rows, outputs);
+            for (int i = 0; i < rows; i++) {
+                if (preds[i] == (int)digits[tile + i]) et->model_correct[k]++;
+                for (int j = 0; j < outputs; j++) {
+                    sum[i][j] += out[i][j];
+                }
+            }
+            free(preds);
+            free_matrix(out);
+        }
+
+        // argmax of the sum is the argmax of the average
+        int *preds = argmax(sum, rows, outputs);
+        for (int i = 0; i < rows; i++) {
+            et->predictions[tile + i] = preds[i];
+            if (preds[i] == (int)digits[tile + i]) et->ensemble_correct++;
+        }
+        free(preds);
+    }
+
+    free_matrix(sum);
+    return NULL;
+}
+
+// Evaluate several seeds in one pass over the data: per-model accuracy and
+// the accuracy of the averaged network outputs.
+void ensemble_evaluate(double **data, char *path, int *seeds, int nmodels) {
+    extern int thread_count;
+    TimingInfo load_timing, eval_timing;
+
+    start_timing(&load_timing, "Ensemble Model Loading");
+    Model *models = calloc(nmodels, sizeof(Model));
+    for (int k = 0; k < nmodels; k++) {
+        if (load_model(&models[k], path, seeds[k]) != 0) {
+            fprintf(stderr, "Error: Could not load the parameters for seed %d\n", seeds[k]);
+            exit(1);
+        }
+    }
+    end_timing(&load_timing);
+
+    printf("\n=== Starting Ensemble Evaluation of %d models with %d threads ===\n", nmodels, thread_count);
+    start_timing(&eval_timing, "Ensemble Forward Pass");
+    int *predictions = malloc(data_nrows * sizeof(int));
+    int rows_per_thread = data_nrows / thread_count;
+    EnsembleThreadData *et = calloc(thread_count, sizeof(EnsembleThreadData));
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+
+    for (int i = 0; i < thread_count; i++) {
+        et[i].start = i * rows_per_thread;
+        et[i].end = (i == thread_count-1) ? data_nrows : (i+1)*rows_per_thread;
+        et[i].input_data = data;
+        et[i].models = models;
+        et[i].nmodels = nmodels;
+        et[i].predictions = predictions;
+        et[i].model_correct = calloc(nmodels, sizeof(int));
+        if (pthread_create(&threads[i], NULL, ensemble_thread, &et[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    int ensemble_correct = 0;
+    int *model_correct = calloc(nmodels, sizeof(int));
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+        ensemble_correct += et[i].ensemble_correct;
+        for (int k = 0; k < nmodels; k++) {
+            model_correct[k] += et[i].model_correct[k];
+        }
+        free(et[i].model_correct);
+    }
+    end_timing(&eval_timing);
+
+    printf("\n=== Ensemble Results ===\n");
+    printf("┌─────────────────────────────────────┬───────────────┐\n");
+    printf("│ Model                               │   Accuracy    │\n");
+    printf("├─────────────────────────────────────┼───────────────┤\n");
+    for (int k = 0; k < nmodels; k++) {
+        char label[64];
+        sprintf(label, "Seed %d", seeds[k]);
+        printf("│ %-36s│ %12.2f%% │\n", label, model_correct[k] * 100.0 / data_nrows);
+    }
+    printf("├─────────────────────────────────────┼───────────────┤\n");
+    printf("│ %-36s│ %12.2f%% │\n", "Ensemble (averaged outputs)", ensemble_correct * 100.0 / data_nrows);
+    printf("└─────────────────────────────────────┴───────────────┘\n");
+
+    print_timing_header();
+    print_timing(&load_timing);
+    print_timing(&eval_timing);
+    print_timing_footer();
+
+    free(model_correct);
+    free(et);
+    free(threads);
+    free(predictions);
+    for (int k = 0; k < nmodels; k++) {
+        unload_model(&models[k]);
+    }
+    free(models);
+}
+
+// Training: mini-batch SGD on softmax cross-entropy. Every mini-batch is
+// split across the threads; each one back-propagates its share into its own
+// gradient buffers, and after a barrier each thread sums and applies a
+// disjoint slice of the parameters, so the reduction needs no locks.
+#define TRAIN_BATCH_ROWS 128
+#define TRAIN_EVAL_ROWS 256
+#define TRAIN_HOLDOUT_PERCENT 10  // last slice of the initial shuffle, never trained on
+#define TRAIN_OUTPUT_BIAS 0.1     // initial layer-3 bias: outputs start above the ReLU
+double train_learning_rate = 0.1;
+
+// grad_w (in x out) += input^T * delta, grad_b += column sums of delta
+static void accumulate_gradients(double **grad_w, double *grad_b, double **input, double **delta,
+                                 int rows, int in, int out) {
+    for (int i = 0; i < rows; i++) {
+        for (int k = 0; k < in; k++) {
+            double x = input[i][k];
+            if (x == 0) continue;  // ReLU zeros contribute nothing
+            for (int j = 0; j < out; j++) {
+                grad_w[k][j] += x * delta[i][j];
+            }
+        }
+        for (int j = 0; j < out; j++) {
+            grad_b[j] += delta[i][j];
+        }
+    }
+}
+
+// delta * weights^T (rows x in), zeroed where ReLU clipped the activation
+static double** backprop_delta(double **delta, double **weights, double **activation,
+                               int rows, int in, int out) {
+    double **result = alloc_matrix(rows, in);
+    for (int i = 0; i < rows; i++) {
+        for (int k = 0; k < in; k++) {
+            if (activation[i][k] <= 0) continue;
+            double sum = 0;
+            for (int j = 0; j < out; j++) {
+                sum += delta[i][j] * weights[k][j];
+            }
+            result[i][k] = sum;
+        }
+    }
+    return result;
+}
+
+// Forward and backward pass over this thread's rows of one mini-batch.
+static void train_batch(TrainThreadData *tt, int *rows_idx, int rows, int batch_rows) {
+    Model *m = &tt->state->model;
+    double **act[4];
+    double **input = tt->batch;
+
+    // Forward, keeping every activation. The output layer goes through ReLU
+    // as well, as in thread_forward(), so the exported parameters are run
+    // with the activation they were trained with.
+    for (int l = 0; l < 4; l++) {
+        double **prev = (l == 0) ? input : act[l - 1];
+        act[l] = mat_mul(prev, rows, matrices_rows[l], m->weights[l], matrices_columns[l]);
+        act[l] = sum_vect(act[l], m->biases[l], rows, matrices_columns[l]);
+        act[l] = relu(act[l], rows, matrices_columns[l]);
+    }
+
+    // Softmax cross-entropy over the ReLU outputs; the output becomes
+    // dLoss/dlogits, zero where the output ReLU clipped the logit
+    int outputs = matrices_columns[3];
+    for (int i = 0; i < rows; i++) {
+        double *z = act[3][i];
+        int label = (int)digits[rows_idx[i]];
+        int clipped[NUM_CLASSES];
+        int best = 0;
+        double max = z[0], sum = 0;
+        for (int j = 0; j < outputs; j++) {
+            clipped[j] = (z[j] <= 0);
+        }
+        for (int j = 1; j < outputs; j++) {
+            if (z[j] > max) { max = z[j]; best = j; }
+        }
+        for (int j = 0; j < outputs; j++) {
+            z[j] = exp(z[j] - max);
+            sum += z[j];
+        }
+        for (int j = 0; j < outputs; j++) {
+            z[j] /= sum;
+        }
+        tt->loss -= log(z[label] > 1e-300 ? z[label] : 1e-300);
+        if (best == label) tt->correct++;
+        z[label] -= 1.0;
+        for (int j = 0; j < outputs; j++) {
+            z[j] = clipped[j] ? 0 : z[j] / batch_rows;
+        }
+    }
+
+    // Backward
+    double **delta = act[3];
+    for (int l = 3; l >= 0; l--) {
+        double **prev = (l == 0) ? input : act[l - 1];
+        accumulate_gradients(tt->grad_w[l], tt->grad_b[l], prev, delta, rows, matrices_rows[l], matrices_columns[l]);
+        if (l > 0) {
+            double **next = backprop_delta(delta, m->weights[l], prev, rows, matrices_rows[l], matrices_columns[l]);
+            free_matrix(delta);
+            delta = next;
+        }
+    }
+    free_matrix(delta);
+    for (int l = 0; l < 3; l++) {
+        free_matrix(act[l]);
+    }
+}
+
+// Sum the gradients of every thread for this thread's slice of the
+// parameters and take the SGD step on it.
+static void train_reduce_and_update(TrainState *st, int tid) {
+    long lo = st->param_count * tid / st->nthreads;
+    long hi = st->param_count * (tid + 1) / st->nthreads;
+    long off = 0;
+    for (int l = 0; l < 4; l++) {
+        int cols = matrices_columns[l];
+        for (int r = 0; r <= matrices_rows[l]; r++, off += cols) {
+            if (off + cols <= lo || off >= hi) continue;
+            int c0 = (lo > off) ? (int)(lo - off) : 0;
+            int c1 = (hi < off + cols) ? (int)(hi - off) : cols;
+            // Rows 0..in-1 are the weights, row `in` is the bias vector
+            double *param = (r < matrices_rows[l]) ? st->model.weights[l][r] : st->model.biases[l];
+            for (int c = c0; c < c1; c++) {
+                double g = 0;
+                for (int t = 0; t < st->nthreads; t++) {
+                    g += (r < matrices_rows[l]) ? st->threads[t].grad_w[l][r][c] : st->threads[t].grad_b[l][c];
+                }
+                param[c] -= train_learning_rate * g;
+            }
+        }
+    }
+}
+
+// Copy rows of the dataset into the batch buffer, scaled to [0, 1].
+static void train_gather(double **batch, double **data, int *rows_idx, int rows) {
+    for (int i = 0; i < rows; i++) {
+        for (int k = 0; k < data_ncols; k++) {
+            batch[i][k] = data[rows_idx[i]][k] * (1.0 / 255.0);
+        }
+    }
+}
+
+void* train_thread(void *arg) {
+    TrainThreadData *tt = (TrainThreadData *)arg;
+    TrainState *st = tt->state;
+    int tid = tt->thread_id;
+    int share = (TRAIN_BATCH_ROWS + st->nthreads - 1) / st->nthreads;
+    TimingInfo epoch_timing, eval_timing;
+
+    for (int epoch = 1; epoch <= st->epochs; epoch++) {
+        if (tid == 0) {
+            // Fisher-Yates shuffle of the training rows; the held-out slice stays put
+            for (int i = st->train_rows - 1; i > 0; i--) {
+                int j = rand_r(&st->shuffle_seed) % (i + 1);
+                int tmp = st->order[i];
+                st->order[i] = st->order[j];
+                st->order[j] = tmp;
+            }
+            start_timing(&epoch_timing, "Epoch");
+        }
+        tt->loss = 0;
+        tt->correct = 0;
+        tt->eval_correct = 0;
+        pthread_barrier_wait(&st->barrier);
+
+        for (int b = 0; b < st->train_rows; b += TRAIN_BATCH_ROWS) {
+            int batch_rows = (st->train_rows - b < TRAIN_BATCH_ROWS) ? st->train_rows - b : TRAIN_BATCH_ROWS;
+            int first = b + tid * share;
+            int rows = (first < b + batch_rows) ? b + batch_rows - first : 0;
+            if (rows > share) rows = share;
+
+            for (int l = 0; l < 4; l++) {
+                for (int r = 0; r < matrices_rows[l]; r++) {
+                    memset(tt->grad_w[l][r], 0, matrices_columns[l] * sizeof(double));
+                }
+                memset(tt->grad_b[l], 0, matrices_columns[l] * sizeof(double));
+            }
+            if (rows > 0) {
+                train_gather(tt->batch, st->data, st->order + first, rows);
+                train_batch(tt, st->order + first, rows, batch_rows);
+            }
+            pthread_barrier_wait(&st->barrier);
+            train_reduce_and_update(st, tid);
+            pthread_barrier_wait(&st->barrier);
+        }
+
+        // Accuracy on the held-out rows with the updated parameters
+        if (tid == 0) {
+            end_timing(&epoch_timing);
+            start_timing(&eval_timing, "Evaluation");
+        }
+        int holdout = data_nrows - st->train_rows;
+        int eval_start = st->train_rows + (int)((long)holdout * tid / st->nthreads);
+        int eval_end = st->train_rows + (int)((long)holdout * (tid + 1) / st->nthreads);
+        for (int e = eval_start; e < eval_end; e += TRAIN_EVAL_ROWS) {
+            int rows = (eval_end - e < TRAIN_EVAL_ROWS) ? eval_end - e : TRAIN_EVAL_ROWS;
+            int *idx = st->order + e;
+            train_gather(tt->batch, st->data, idx, rows);
+            double **out = model_forward(&st->model, tt->batch, rows);
+            int *preds = argmax(out, rows, matrices_columns[3]);
+            for (int i = 0; i < rows; i++) {
+                if (preds[i] == (int)digits[idx[i]]) tt->eval_correct++;
+            }
+            free(preds);
+            free_matrix(out);
+        }
+        pthread_barrier_wait(&st->barrier);
+
+        if (tid == 0) {
+            end_timing(&eval_timing);
+            double loss = 0;
+            int correct = 0, eval_correct = 0;
+            for (int t = 0; t < st->nthreads; t++) {
+                loss += st->threads[t].loss;
+                correct += st->threads[t].correct;
+                eval_correct += st->threads[t].eval_correct;
+            }
+            int holdout = data_nrows - st->train_rows;
+            printf("│ %5d │ %8.4f │ %8.2f%% │ %8.2f%% │ %9.3f s │ %9.3f │\n",
+                   epoch, loss / st->train_rows, correct * 100.0 / st->train_rows,
+                   holdout > 0 ? eval_correct * 100.0 / holdout : 0.0, epoch_timing.elapsed_time,
+                   1.0 / epoch_timing.elapsed_time);
+            fflush(stdout);
+        }
+        pthread_barrier_wait(&st->barrier);  // tallies are read before the next epoch resets them
+    }
+    return NULL;
+}
+
+// Train the network from scratch and write the parameters for `out_seed`.
+void train_model(double **data, char *path, int epochs, int out_seed) {
+    extern int thread_count;
+    TrainState st;
+    unsigned init_seed = 1234u + out_seed;
+
+    memset(&st, 0, sizeof(st));
+    st.nthreads = thread_count;
+    st.epochs = epochs;
+    st.shuffle_seed = 42u + out_seed;
+    st.data = data;
+    st.order = malloc(data_nrows * sizeof(int));
+    for (int i = 0; i < data_nrows; i++) st.order[i] = i;
+    // One fixed shuffle picks the held-out slice (the last TRAIN_HOLDOUT_PERCENT)
+    for (int i = data_nrows - 1; i > 0; i--) {
+        int j = rand_r(&st.shuffle_seed) % (i + 1);
+        int tmp = st.order[i];
+        st.order[i] = st.order[j];
+        st.order[j] = tmp;
+    }
+    st.train_rows = data_nrows - data_nrows * TRAIN_HOLDOUT_PERCENT / 100;
+
+    // He initialization (Box-Muller), zero hidden biases. The output ReLU
+    // passes no gradient for a logit <= 0, so an output that started (and
+    // stayed) negative for every row of its digit would never learn; the
+    // output biases start positive so every class begins active.
+    for (int l = 0; l < 4; l++) {
+        st.model.weights[l] = alloc_matrix(matrices_rows[l], matrices_columns[l]);
+        st.model.biases[l] = calloc(matrices_columns[l], sizeof(double));
+        for (int c = 0; l == 3 && c < matrices_columns[l]; c++) {
+            st.model.biases[l][c] = TRAIN_OUTPUT_BIAS;
+        }
+        double std = sqrt(2.0 / matrices_rows[l]);
+        for (int r = 0; r < matrices_rows[l]; r++) {
+            for (int c = 0; c < matrices_columns[l]; c++) {
+                double u1 = (rand_r(&init_seed) + 1.0) / (RAND_MAX + 2.0);
+                double u2 = (rand_r(&init_seed) + 1.0) / (RAND_MAX + 2.0);
+                st.model.weights[l][r][c] = std * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+            }
+        }
+        st.param_count += (long)(matrices_rows[l] + 1) * matrices_columns[l];
+    }
+
+    int share = (TRAIN_BATCH_ROWS + thread_count - 1) / thread_count;
+    int batch_alloc = (share > TRAIN_EVAL_ROWS) ? share : TRAIN_EVAL_ROWS;
+    st.threads = calloc(thread_count, sizeof(TrainThreadData));
+    for (int t = 0; t < thread_count; t++) {
+        st.threads[t].thread_id = t;
+        st.threads[t].state = &st;
+        st.threads[t].batch = alloc_matrix(batch_alloc, data_ncols);
+        for (int l = 0; l < 4; l++) {
+            st.threads[t].grad_w[l] = alloc_matrix(matrices_rows[l], matrices_columns[l]);
+            st.threads[t].grad_b[l] = calloc(matrices_columns[l], sizeof(double));
+        }
+    }
+    pthread_barrier_init(&st.barrier, NULL, thread_count);
+
+    printf("\n=== Training %d epochs with %d threads (batch %d, learning rate %.3f) ===\n",
+           epochs, thread_count, TRAIN_BATCH_ROWS, train_learning_rate);
+    printf("Training on %d rows, %d rows (%d%%) held out for evaluation\n", st.train_rows,
+           data_nrows - st.train_rows, TRAIN_HOLDOUT_PERCENT);
+    printf("┌───────┬──────────┬───────────┬───────────┬─────────────┬───────────┐\n");
+    printf("│ Epoch │   Loss   │ Train acc │ Held-out  │ Epoch time  │ Epochs/s  │\n");
+    printf("├───────┼──────────┼───────────┼───────────┼─────────────┼───────────┤\n");
+
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    for (int t = 0; t < thread_count; t++) {
+        if (pthread_create(&threads[t], NULL, train_thread, &st.threads[t]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    printf("└───────┴──────────┴───────────┴───────────┴─────────────┴───────────┘\n");
+
+    // Fold the 1/255 input scaling into layer 0 so the files take raw pixels
+    for (int r = 0; r < matrices_rows[0]; r++) {
+        for (int c = 0; c < matrices_columns[0]; c++) {
+            st.model.weights[0][r][c] /= 255.0;
+        }
+    }
+    char file[512];
+    for (int l = 0; l < 4; l++) {
+        sprintf(file, "%sparameters/weights%d_%d.csv", path, l, out_seed);
+        write_matrix(st.model.weights[l], file, matrices_rows[l], matrices_columns[l]);
+        sprintf(file, "%sparameters/biases%d_%d.csv", path, l, out_seed);
+        write_vector(st.model.biases[l], file, vector_rows[l]);
+    }
+
+    pthread_barrier_destroy(&st.barrier);
+    for (int t = 0; t < thread_count; t++) {
+        free_matrix(st.threads[t].batch);
+        for (int l = 0; l < 4; l++) {
+            free_matrix(st.threads[t].grad_w[l]);
+            free(st.threads[t].grad_b[l]);
+        }
+    }
+    free(st.threads);
+    free(threads);
+    free(st.order);
+    unload_model(&st.model);
+}
+
 // global variable to hold thread_count extracted from argv
 int thread_count;
  
@@ -854,16 +4067,43 @@ int main(int argc, char *argv[]) {
     TimingInfo total_execution;
     start_timing(&total_execution, "Total Execution");
     
-    if (argc < 2) {
-        printf("Usage: %s <num_threads>\n", argv[0]);
-        exit(1);
+    // The thread count may be left out once an autotune profile exists:
+    // treat "./main [mode ...]" as "./main 0 [mode ...]" (0 = from the profile)
+    if (argc < 2 || strspn(argv[1], "0123456789") != strlen(argv[1])) {
+        char **args = malloc((argc + 2) * sizeof(char *));
+        args[0] = argv[0];
+        args[1] = "0";
+        for (int i = 1; i <= argc; i++) args[i + 1] = argv[i];
+        argc++;
+        argv = args;
     }
     thread_count = atoi(argv[1]);
-    if (thread_count <= 0) {
-        printf("Invalid thread count provided\n");
+
+    // Optional mode after the thread count (empty = viewer + inference)
+    const char *mode = (argc > 2) ? argv[2] : "";
+    const char *modes[] = {"", "lowrank", "ensemble", "train", "hugepages", "convert", "view", "eval", "autotune",
+                           "latency", "hotswap", "shard", NULL};
+    int known_mode = 0;
+    for (int i = 0; modes[i] != NULL; i++) {
+        if (strcmp(mode, modes[i]) == 0) known_mode = 1;
+    }
+    if (!known_mode) {
+        printf("Unknown mode: %s\n", mode);
         exit(1);
     }
 
+    // "lowrank" sweeps the layer-0 rank, "lowrank <r>" runs with rank r
+    int requested_rank = 0;
+    if (strcmp(mode, "lowrank") == 0 && argc > 3) {
+        requested_rank = atoi(argv[3]);
+        if (requested_rank <= 0 || requested_rank > matrices_columns[0]) {
+            printf("Invalid rank provided (must be 1..%d)\n", matrices_columns[0]);
+            exit(1);
+        }
+    }
+    // "view" and "eval" read image rows on demand instead of loading them all
+    int lazy_load = (strcmp(mode, "view") == 0 || strcmp(mode, "eval") == 0);
+
     TimingInfo timings[10];  // Array to store timing information
     int timing_index = 0;
     
@@ -885,32 +4125,71 @@ int main(int argc, char *argv[]) {
     char test_path[256];
     int path_found = 0;
     
-    for (int i = 0; paths[i].path != NULL; i++) {
-        sprintf(test_path, "%scsvs/data.csv", paths[i].path);
-        FILE *test = fopen(test_path, "r");
-        if (test) {
-            fclose(test);
-            my_path = strdup(paths[i].path);
-            path_found = 1;
-            printf("Using path: %s\n", my_path);
-            break;
+    const char *dataset_files[] = {"data.bin", "data.idx", "data.csv"};
+    for (int i = 0; paths[i].path != NULL && !path_found; i++) {
+        for (int f = 0; f < 3; f++) {
+            sprintf(test_path, "%scsvs/%s", paths[i].path, dataset_files[f]);
+            FILE *test = fopen(test_path, "r");
+            if (test) {
+                fclose(test);
+                my_path = strdup(paths[i].path);
+                path_found = 1;
+                printf("Using path: %s\n", my_path);
+                break;
+            }
         }
     }
     
     if (!path_found) {
-        printf("The data.csv file was not found in any of the tested paths.\n");
+        printf("No data.bin, data.idx or data.csv file was found in any of the tested paths.\n");
         printf("Please specify the correct path in the 'my_path' variable.\n");
         return 1;
     }
+
+    // Apply this host's autotune profile; an explicit thread count wins
+    AutotuneProfile profile;
+    if (autotune_load(my_path, &profile)) {
+        micro_batch_rows = profile.micro_batch;
+        matmul_tile_rows = profile.tile_rows;
+        matmul_tile_k = profile.tile_k;
+        if (thread_count == 0) thread_count = profile.threads;
+        printf("Autotune profile: %d threads, micro-batch %d, tiles %dx%d\n",
+               profile.threads, micro_batch_rows, matmul_tile_rows, matmul_tile_k);
+    }
+    if (thread_count <= 0 && strcmp(mode, "autotune") != 0) {
+        printf("Usage: %s <num_threads> [lowrank [rank] | ensemble <seed>... | train [epochs] [out_seed] |\n"
+               "                          hugepages | convert | view | eval <first_row> <count> | autotune |\n"
+               "                          latency [requests] | hotswap <seed> | shard <processes>]\n", argv[0]);
+        printf("The thread count can only be omitted after running '%s autotune' on this CPU.\n", argv[0]);
+        exit(1);
+    }
     
     // Start timing data loading
     start_timing(&timings[timing_index], "Data Loading");
-    load_data(my_path);
+    if (lazy_load) {
+        load_data_lazy(my_path);
+    } else {
+        load_data(my_path);
+    }
     end_timing(&timings[timing_index++]);
+
+    // The cache only pays off when rows repeat, so it is opt-in; the hot-swap
+    // demo always uses it. Two entries per row (4-way buckets fill unevenly),
+    // up to CACHE_MAX_ENTRIES.
+    const char *cache_env = getenv("NN_CACHE");
+    cache_enabled = (cache_env && atoi(cache_env) != 0) || strcmp(mode, "hotswap") == 0;
+    if (cache_enabled) {
+        int granule = CACHE_SHARDS * CACHE_WAYS;
+        cache_capacity = (2 * data_nrows + granule - 1) / granule * granule;
+        if (cache_capacity > CACHE_MAX_ENTRIES) cache_capacity = CACHE_MAX_ENTRIES;
+        prediction_cache_init(cache_capacity);
+        printf("Prediction cache: %d entries (%.1f MB)\n", cache_capacity,
+               cache_capacity * (sizeof(CacheEntry) + CACHE_KEY_WORDS * sizeof(uint64_t)) / 1e6);
+    }
     
     // Verify if the data was loaded correctly
     int datos_validos = 1;
-    for (int i = 0; i < 10 && i < data_nrows; i++) {
+    for (int i = 0; data && i < 10 && i < data_nrows; i++) {
         int zeros_count = 0;
         for (int j = 0; j < data_ncols; j++) {
             if (data[i][j] == 0) zeros_count++;
@@ -924,21 +4203,181 @@ int main(int argc, char *argv[]) {
     if (!datos_validos) {
         printf("Warning: Possible issue with reading data.csv. Check the file format.\n");
     }
+
+    if (strcmp(mode, "view") == 0) {
+        int num_images = data ? data_nrows : data_index.nrows;
+        printf("\nLoaded in %.4f seconds, starting the viewer\n", timings[0].elapsed_time);
+        view_mnist_images(data, num_images, labels);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "eval") == 0) {
+        int available = data ? data_nrows : data_index.nrows;
+        int first = (argc > 3) ? atoi(argv[3]) : 0;
+        int count = (argc > 4) ? atoi(argv[4]) : available - first;
+        if (first < 0 || count <= 0 || first + count > available || first + count > data_nrows) {
+            printf("Invalid row range provided (rows 0..%d available)\n", available - 1);
+            exit(1);
+        }
+        start_timing(&timings[timing_index], "Row Range Loading");
+        double **rows = data ? NULL : alloc_matrix(count, data_ncols);
+        if (rows) {
+            row_index_read_rows(&data_index, first, count, rows);
+        }
+        end_timing(&timings[timing_index++]);
+
+        start_timing(&timings[timing_index], "Forward Pass");
+        int *predictions = parallel_forward_rows(rows ? rows : data + first, labels + first, count);
+        end_timing(&timings[timing_index++]);
+        eval_result.row_base = first;
+        double accuracy = final_result(&eval_result);
+        printf("\nRows %d to %d: Prediction Accuracy %.2f%%\n", first, first + count - 1, accuracy);
+        error_log(&eval_result, 100);
+        print_eval_report(&eval_result);
+
+        print_timing_header();
+        for (int i = 0; i < timing_index; i++) {
+            print_timing(&timings[i]);
+        }
+        print_timing_footer();
+
+        free(predictions);
+        prediction_cache_free();
+        free_matrix(rows);
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "lowrank") == 0 && requested_rank == 0) {
+        lowrank_sweep(data);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "ensemble") == 0) {
+        int nmodels = (argc > 3) ? argc - 3 : 1;
+        int *seeds = malloc(nmodels * sizeof(int));
+        for (int k = 0; k < nmodels; k++) {
+            seeds[k] = (argc > 3) ? atoi(argv[3 + k]) : seed;
+        }
+        ensemble_evaluate(data, my_path, seeds, nmodels);
+        free(seeds);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "convert") == 0) {
+        convert_dataset(my_path);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "hugepages") == 0) {
+        hugepage_benchmark(data);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "shard") == 0) {
+        int nshards = (argc > 3) ? atoi(argv[3]) : 4;
+        if (nshards <= 0 || nshards > SHARD_MAX || nshards > data_nrows) {
+            printf("Invalid shard count provided (1..%d)\n", SHARD_MAX);
+            exit(1);
+        }
+        shard_evaluate(data, nshards);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "hotswap") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s <num_threads> hotswap <seed>\n", argv[0]);
+            exit(1);
+        }
+        hotswap_demo(data, my_path, atoi(argv[3]));
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "latency") == 0) {
+        int samples = (argc > 3) ? atoi(argv[3]) : 10000;
+        if (samples <= 0) {
+            printf("Invalid request count provided\n");
+            exit(1);
+        }
+        latency_benchmark(data, samples);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "autotune") == 0) {
+        // Without a thread count, try up to twice the online cores
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int max_threads = (atoi(argv[1]) > 0) ? atoi(argv[1]) : (cores > 0 ? 2 * (int)cores : 8);
+        autotune(data, my_path, max_threads);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (strcmp(mode, "train") == 0) {
+        int epochs = (argc > 3) ? atoi(argv[3]) : 5;
+        int out_seed = (argc > 4) ? atoi(argv[4]) : 0;
+        if (epochs <= 0) {
+            printf("Invalid epoch count provided\n");
+            exit(1);
+        }
+        train_model(data, my_path, epochs, out_seed);
+        prediction_cache_free();
+        unload_data();
+        return 0;
+    }
+
+    if (requested_rank > 0) {
+        start_timing(&timings[timing_index], "Low-Rank Factorization");
+        int energy = lowrank_factorize(mat1, matrices_rows[0], matrices_columns[0], requested_rank, &mat1_a, &mat1_b);
+        if (energy < 0) exit(1);
+        lowrank_rank = requested_rank;
+        end_timing(&timings[timing_index++]);
+        printf("\nLayer 0 factorized to rank %d (%d%% of the spectral energy kept)\n", lowrank_rank, energy);
+    }
     
-    // Time the MNIST viewer
+    // Start inference right away on a coordinator thread; the viewer owns the
+    // main thread and shows predictions as the workers publish them.
+    // SIGHUP reloads the parameters while the program runs
+    reload_watcher_start(my_path);
+    printf("\nSend SIGHUP (kill -HUP %d) to reload the parameters without stopping inference\n", (int)getpid());
+    InferenceJob job = { .data = data, .timing = &timings[timing_index++] };
+    inference_job_open(&job);
+    pthread_t coordinator;
+    if (pthread_create(&coordinator, NULL, inference_coordinator, &job) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    // Time the MNIST viewer (the forward pass is timed separately)
     start_timing(&timings[timing_index], "MNIST Viewing time");
-    // Show the MNIST image viewer
     printf("\n=== Starting MNIST Image Viewer ===\n");
-    printf("Use the left/right arrows to navigate between images\n");
-    printf("Press ESC to close the viewer and continue with the program\n");
-    view_mnist_images(data, data_nrows);
-    end_timing(&timings[timing_index++]);
-    printf("\n=== Viewer closed, continuing with the program ===\n");
-    
-    // Time the forward pass using the new parallel variant.
-    start_timing(&timings[timing_index], "Forward Pass");
-    int *predictions = parallel_forward_pass(data);
+    printf("Use the left/right arrows to navigate, 'g' for the thumbnail grid,\n");
+    printf("'m' to show only misclassified images, ESC to close the viewer\n");
+    view_mnist_images(data, data_nrows, labels);
     end_timing(&timings[timing_index++]);
+    printf("\n=== Viewer closed, waiting for the forward pass ===\n");
+
+    pthread_join(coordinator, NULL);
+    reload_watcher_stop();
+    int *predictions = job.predictions;
+    long long dtlb_misses = job.dtlb_misses;
+    long huge_kb = job.huge_kb;
     
     // Time the accuracy calculation
     start_timing(&timings[timing_index], "Accuracy Calculation");
@@ -948,9 +4387,10 @@ int main(int argc, char *argv[]) {
         printf("Sample %d: Predicted %d, Actual %.0f\n", i, predictions[i], digits[i]);
     }
 
-    double accuracy = final_result(predictions, digits, data_nrows);
+    double accuracy = final_result(&eval_result);
     printf("\nFinal Prediction Accuracy: %.2f%%\n", accuracy);
-    error_log(predictions, digits, data_nrows, 1000);
+    error_log(&eval_result, MAX_LOGGED_ERRORS);
+    print_eval_report(&eval_result);
     end_timing(&timings[timing_index++]);
     
     // Print final results
@@ -968,9 +4408,29 @@ int main(int argc, char *argv[]) {
     
     printf("├─────────────────────────────────────┼───────────────┤\n");
     print_timing(&total_execution);  // Print total execution time
+    printf("├─────────────────────────────────────┼───────────────┤\n");
+    if (cache_enabled) {
+        print_counter("Prediction cache hits", cache_hits_total);
+        print_counter("Prediction cache misses", cache_misses_total);
+        print_counter("Rows the cache cannot key", cache_uncacheable_total);
+        print_counter("Prediction cache evictions", prediction_cache_evictions());
+    } else {
+        print_info("Prediction cache", "off");
+    }
+    printf("├─────────────────────────────────────┼───────────────┤\n");
+    print_counter("Model generation at exit", atomic_load(&live_model)->generation);
+    print_info("Dataset backing", backing_name(data_backing));
+    print_counter("Huge pages in use (KB)", huge_kb);
+    if (dtlb_misses >= 0) {
+        print_counter("dTLB misses (forward pass)", (long)dtlb_misses);
+    } else {
+        print_info("dTLB misses (forward pass)", "n/a");
+    }
     print_timing_footer();
     
     free(predictions);
+    prediction_cache_free();
+    lowrank_unload();
     unload_data();
     return 0;
 }